@@ -1,8 +1,8 @@
 #include "particle_grid.h"
+#include "undo_history.h"
 
-#include <stack>
 #include <vector>
-#include <unordered_set>
+#include <unordered_map>
 
 
 #define BRUSH_SHAPE_LIST \
@@ -31,10 +31,10 @@ class Brush
 public:
     Brush(int radius, ParticleType particleType);
 
-    void handleEvent(SDL_Event* event, bool isUiFocused);
+    // isUiFocused: ImGui wants the mouse. isUiTyping: ImGui wants the keyboard, so key shortcuts are ignored
+    void handleEvent(SDL_Event* event, bool isUiFocused, bool isUiTyping);
     void update();
 
-    void selectFill();
     void floodFill();
 
     void setCanvas(ParticleGrid* canvas);
@@ -50,19 +50,30 @@ public:
     int radius() const;
     float rotation() const;
 
-    Cell* hoveredCell() const;
+    // Index of the cell under the cursor, -1 if none
+    int hoveredCell() const;
+    // Maps the cursor through the canvas camera again; call after the camera moves
+    void refreshHover();
 
     void toggleHighlight();
     bool highlight() const;
 
+    UndoHistory& history() { return m_history; }
+    const UndoHistory& history() const { return m_history; }
+
     static constexpr int kMinRadius { 1 };
     static constexpr int kMaxRadius { 25 };
     // Scales the rate at which the scroll wheel resizes the brush
     static constexpr int kRadiusResizeScale { 1 };
     static constexpr float kRotationScale { 0.1f };
+    // Stamps are built for this many rotations per quarter turn; a square looks the same every quarter turn
+    static constexpr int kRotationSteps { 64 };
 
 private:
     int m_x, m_y;
+    // Cursor position in screen pixels
+    float m_mouseX { 0.f };
+    float m_mouseY { 0.f };
     int m_radius;
     float m_rot;
     bool m_isDown;
@@ -72,28 +83,36 @@ private:
     ParticleType m_particleType2;
     ParticleGrid* m_canvas;
 
-    std::vector<Cell*> m_selectedCells;
-    Cell* m_hoveredCell;
-
-    // Stores canvas states when edits are made
-    struct CompoundState
-    {
-        ParticleState particleState;
-        CellState cellState;
-    };
-    std::stack<std::vector<CompoundState>> m_canvasStateStack;
-    void pushCanvasState();
-    void popCanvasState();
-
-    // Outline of the brush
-    struct Shape
-    {
-        std::unordered_set<Cell*> outline;
-        int x, y;
-    };
-    Shape m_shape;
-    void setShapeCircle();
-    void setShapeSquare();
+    int m_hoveredCell;
+
+    // One entry per stroke or fill; cells are recorded right before the brush changes them
+    UndoHistory m_history;
+    // Mouse button that opened the stroke's edit, 0 if none is open
+    uint8_t m_editButton { 0 };
+
+    using Span = CellSpan;
+    // Cells under the brush as row spans relative to its centre. Built once per shape, radius and rotation step
+    using Stamp = std::vector<Span>;
+    std::unordered_map<uint32_t, Stamp> m_stampCache;
+    const Stamp* m_stamp { nullptr };
+    // The stamp as placed on the canvas, clipped to the grid
+    std::vector<Span> m_selectedSpans;
+    // Brush positions since the last paint while a button is held, oldest first
+    std::vector<std::pair<int, int>> m_strokePath;
+    // Where the stroke was last painted, or where it was pressed until its first paint
+    int m_strokeX { 0 };
+    int m_strokeY { 0 };
+    bool m_strokeStarted { false };
+    // Cells swept since the last paint, as disjoint spans in row order
+    std::vector<Span> m_strokeSpans;
+    // Paints the swept spans, or the current stamp if the cursor hasn't moved
+    void paintStroke();
+    void sweepStroke();
+    // Picks the stamp for the current shape, radius and rotation, then places it
+    void updateStamp();
+    // Moves the selection to the stamp at the brush position
+    void placeStamp();
+    static Stamp buildStamp(BrushType type, int radius, int rotationStep);
 
     BrushType m_brushType;
 
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <SDL3/SDL_rect.h>
+
+#include "chunk_map.h"
+
+
+// Maps screen pixels to grid cells. The view's top-left corner sits at cell-space (x, y) and
+// each cell covers zoom() screen pixels; zoom never drops below the level that fits the whole grid
+class Camera
+{
+public:
+    Camera(int gridWidth, int gridHeight, float viewportWidth, float viewportHeight);
+
+    static constexpr float kMaxZoom { 64.f };
+    // Zoom factor per Alt + scroll notch
+    static constexpr float kZoomStep { 1.25f };
+
+    void setViewport(float width, float height);
+    // Fits the whole grid on screen, centred
+    void reset();
+    // Scales the zoom by factor, keeping the cell under screen point (screenX, screenY) in place
+    void zoomAt(float factor, float screenX, float screenY);
+    // Moves the view by a distance in screen pixels
+    void pan(float dx, float dy);
+
+    float zoom() const { return m_zoom; }
+    float minZoom() const;
+    float x() const { return m_x; }
+    float y() const { return m_y; }
+
+    // Cell under a screen point; may lie outside the grid
+    void screenToCell(float screenX, float screenY, int& cellX, int& cellY) const;
+    // Grid cells at least partly on screen (inclusive); empty if none are
+    DirtyRect visibleCells() const;
+    // Screen rect covered by an inclusive cell rect
+    SDL_FRect screenRect(const DirtyRect& cells) const;
+
+private:
+    const int m_gridWidth;
+    const int m_gridHeight;
+    float m_viewportWidth;
+    float m_viewportHeight;
+
+    float m_x { 0.f };
+    float m_y { 0.f };
+    float m_zoom { 1.f };
+
+    // Keeps the grid covering the screen, or centred on the axes where it is smaller than the screen
+    void clampView();
+
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <climits>
+
+
+// Inclusive cell rectangle; empty when minX > maxX
+struct DirtyRect
+{
+    int minX { INT_MAX };
+    int minY { INT_MAX };
+    int maxX { INT_MIN };
+    int maxY { INT_MIN };
+
+    bool empty() const { return minX > maxX; }
+    void reset() { *this = DirtyRect(); }
+    void include(int x0, int y0, int x1, int y1)
+    {
+        if (x0 < minX) minX = x0;
+        if (y0 < minY) minY = y0;
+        if (x1 > maxX) maxX = x1;
+        if (y1 > maxY) maxY = y1;
+    }
+    // Same as include(), safe to call from several workers at once
+    void includeAtomic(int x0, int y0, int x1, int y1)
+    {
+        atomicMin(minX, x0);
+        atomicMin(minY, y0);
+        atomicMax(maxX, x1);
+        atomicMax(maxY, y1);
+    }
+
+private:
+    static void atomicMin(int& target, int value)
+    {
+        std::atomic_ref<int> ref(target);
+        int current = ref.load(std::memory_order_relaxed);
+        while (value < current && !ref.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+    }
+    static void atomicMax(int& target, int value)
+    {
+        std::atomic_ref<int> ref(target);
+        int current = ref.load(std::memory_order_relaxed);
+        while (value > current && !ref.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+    }
+};
+
+struct Chunk
+{
+    // Cells simulated by the movement pass this frame
+    DirtyRect dirty;
+    // Cells woken for the next frame
+    DirtyRect nextDirty;
+
+    // Whether the heat pass visits this chunk this/next frame
+    bool thermalAwake { false };
+    bool nextThermalAwake { false };
+
+    bool asleep() const { return dirty.empty() && !thermalAwake; }
+};
+
+// Splits a grid into fixed-size chunks that go to sleep once nothing in them moves or exchanges heat
+class ChunkMap
+{
+public:
+    ChunkMap(int gridWidth, int gridHeight);
+
+    static constexpr int kChunkSize { 32 };
+
+    // Dimensions in chunks
+    const int width;
+    const int height;
+
+    int chunkIndex(int cellX, int cellY) const { return (cellY / kChunkSize) * width + (cellX / kChunkSize); }
+    Chunk& chunk(int idx) { return m_chunks[idx]; }
+    const Chunk& chunk(int idx) const { return m_chunks[idx]; }
+    int count() const { return static_cast<int>(m_chunks.size()); }
+
+    // Cell bounds of a chunk (inclusive)
+    int chunkMinX(int idx) const { return (idx % width) * kChunkSize; }
+    int chunkMinY(int idx) const { return (idx / width) * kChunkSize; }
+    int chunkMaxX(int idx) const;
+    int chunkMaxY(int idx) const;
+
+    // Wakes (x, y) and its neighbours for the next frame, reaching into adjacent chunks at the edges.
+    // Wake calls are safe to make from several workers at once
+    void wakeCell(int x, int y);
+    // Wakes an inclusive cell rectangle for the next frame
+    void wakeRect(int x0, int y0, int x1, int y1);
+    // Keeps a chunk and its 4 neighbours in the heat pass next frame
+    void wakeThermal(int idx);
+    void wakeAll();
+
+    // Promotes next-frame wake state to the current frame
+    void step();
+
+    int awakeCount() const;
+
+private:
+    const int m_gridWidth;
+    const int m_gridHeight;
+
+    std::vector<Chunk> m_chunks;
+
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+#define FRAME_FORMAT_LIST \
+    X(Qoi, "qoi") \
+    X(Raw, "rgba")
+
+enum class FrameFormat
+{
+#define X(NAME, EXT) NAME,
+    FRAME_FORMAT_LIST
+#undef X
+    COUNT
+};
+// Also the file extension of each format
+constexpr const char* kFrameFormatNames[] =
+{
+#define X(NAME, EXT) EXT,
+    FRAME_FORMAT_LIST
+#undef X
+};
+
+// Writes 0xRRGGBBAA frames to <directory>/frame_NNNNNN.<ext> on a background thread.
+// submit() never blocks: once capacity frames are waiting, new ones are dropped and counted
+class FrameWriter
+{
+public:
+    FrameWriter(std::filesystem::path directory, FrameFormat format, int width, int height, int capacity = 8);
+    // Writes out every frame still queued
+    ~FrameWriter();
+    FrameWriter(const FrameWriter&) = delete;
+    FrameWriter& operator=(const FrameWriter&) = delete;
+
+    // A width * height buffer to fill and submit, reused from frames already written when possible
+    std::vector<uint32_t> acquireBuffer();
+    // Returns false if the queue was full and the frame was dropped
+    bool submit(std::vector<uint32_t>&& pixels, uint64_t frameIndex);
+    // Blocks until every submitted frame is on disk
+    void flush();
+
+    int writtenCount() const;
+    int droppedCount() const;
+    // Frames that couldn't be written, e.g. because the directory is missing
+    int failedCount() const;
+
+private:
+    struct Frame
+    {
+        std::vector<uint32_t> pixels;
+        uint64_t index;
+    };
+
+    const std::filesystem::path m_directory;
+    const FrameFormat m_format;
+    const int m_width;
+    const int m_height;
+    const size_t m_capacity;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::condition_variable m_idleCondition;
+    std::deque<Frame> m_queue;
+    std::vector<std::vector<uint32_t>> m_freeBuffers;
+    bool m_stopping { false };
+    bool m_busy { false };
+    int m_written { 0 };
+    int m_dropped { 0 };
+    int m_failed { 0 };
+
+    std::vector<uint8_t> m_encoded;
+    std::thread m_thread;
+
+    void writerLoop();
+    bool writeFrame(const Frame& frame);
+    void encodeQoi(const std::vector<uint32_t>& pixels);
+    void encodeRaw(const std::vector<uint32_t>& pixels);
+
+};
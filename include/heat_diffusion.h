@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+
+
+// 4-neighbour heat exchange stencil over a dense temperature plane (y * width + x).
+// Uses AVX2, SSE2 or WASM SIMD when the build enables them, with a scalar fallback.
+class HeatDiffusion
+{
+public:
+    // Each neighbour pair exchanges 0.05 of their difference from both sides (0.1 total);
+    // cells on the grid border exchange 0.05 with the ambient temperature per missing neighbour
+    static constexpr float kNeighborRate { 0.1f };
+    static constexpr float kAmbientRate { 0.05f };
+
+    void resize(int width, int height);
+    // Temperature outside the grid. Set it before computing deltas, not while workers are computing them
+    void setAmbient(float ambient);
+
+    // Writes the heat gained this step by each cell of the inclusive rect [x0, x1] x [y0, y1] into deltas().
+    // Only reads temperature, so disjoint rects can be computed in parallel
+    void computeDeltas(const float* temperature, int x0, int y0, int x1, int y1);
+    // Scalar reference for computeDeltas(); the SIMD paths use the same operation order
+    void computeDeltasScalar(const float* temperature, int x0, int y0, int x1, int y1);
+
+    const float* deltas() const { return m_delta.data(); }
+    float* deltas() { return m_delta.data(); }
+
+private:
+    int m_width { 0 };
+    int m_height { 0 };
+
+    std::vector<float> m_delta;
+    // Stands in for the rows above/below the grid
+    std::vector<float> m_ambientRow;
+    float m_ambient { 0.f };
+
+    float cellDelta(const float* temperature, int x, int y) const;
+
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstdint>
+
+#include "particles.h"
+#include "util.h"
+
+
+// Colour lookup tables for ParticleGrid::draw(): a base colour per (type, colour variation) and quantized
+// temperature -> RGBA gradients for every TemperatureColorMode, built once so redrawing a cell is table loads
+class Palette
+{
+public:
+    Palette();
+
+    static constexpr int kVariationCount { 5 };
+    // Gradient resolution over [kAbsZero, kMaxTemp], about 0.8 degrees per step
+    static constexpr int kTemperatureSteps { 4096 };
+
+    uint32_t base(ParticleType type, int variation) const { return m_base[static_cast<size_t>(type)][variation]; }
+    uint32_t temperature(float tempC, Util::TemperatureColorMode mode) const
+    {
+        return m_temperature[modeIndex(mode) * kTemperatureSteps + temperatureStep(tempC)];
+    }
+    // Gradient for one mode, indexed by temperatureStep()
+    const uint32_t* gradient(Util::TemperatureColorMode mode) const { return &m_temperature[modeIndex(mode) * kTemperatureSteps]; }
+
+    static int temperatureStep(float tempC)
+    {
+        tempC = std::clamp(tempC, Util::kAbsZero, Util::kMaxTemp);
+        return static_cast<int>((tempC - Util::kAbsZero) * kStepScale + 0.5f);
+    }
+
+private:
+    static constexpr float kStepScale { (kTemperatureSteps - 1) / (Util::kMaxTemp - Util::kAbsZero) };
+    // TemperatureColorMode::COUNT display modes plus Radiation
+    static constexpr int kModeCount { static_cast<int>(Util::TemperatureColorMode::COUNT) + 1 };
+
+    static int modeIndex(Util::TemperatureColorMode mode)
+    {
+        return mode == Util::TemperatureColorMode::Radiation ? kModeCount - 1 : static_cast<int>(mode);
+    }
+
+    std::array<std::array<uint32_t, kVariationCount>, static_cast<size_t>(ParticleType::COUNT)> m_base;
+    // kModeCount gradients of kTemperatureSteps entries
+    std::vector<uint32_t> m_temperature;
+
+};
@@ -2,10 +2,22 @@
 
 #include <SDL3/SDL_rect.h>
 #include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <utility>
 #include <vector>
 #include <cstdlib>
+#include <cstdint>
 
 #include "particles.h"
+#include "camera.h"
+#include "chunk_map.h"
+#include "heat_diffusion.h"
+#include "palette.h"
+#include "render_layer.h"
+#include "thread_pool.h"
+#include "rng.h"
 #include "util.h"
 
 
@@ -13,62 +25,161 @@
 struct SDL_Renderer;
 struct SDL_Texture;
 
-struct ParticleGrid;
 class Brush;
 //////////////////////////
-struct CellState
+// Per-cell bits stored in ParticleGrid's flag plane
+namespace CellFlags
 {
-    float temperature;
-    float temperatureDelta;
+    constexpr uint8_t BrushSelected { 1 << 0 };
+    // Particle already moved this frame; ordered traversals skip it so it can't move twice
+    constexpr uint8_t Moved         { 1 << 1 };
+}
 
-    bool operator==(const CellState& other) const
-    {
-        return (temperature == other.temperature && temperatureDelta == other.temperatureDelta);
-    }
+// Order in which the movement pass visits the cells of a chunk
+#define TRAVERSAL_MODE_LIST \
+    X(Shuffle) \
+    X(Serpentine) \
+    X(RandomRows)
+
+enum class TraversalMode
+{
+#define X(NAME) NAME,
+    TRAVERSAL_MODE_LIST
+#undef X
+    COUNT
 };
-struct Cell
+constexpr std::string kTraversalModeNames[] =
 {
-    Cell(ParticleGrid* particleGrid, int x, int y, ParticleState particleState);
-
-    const int x, y;
-    char colorVariation;
-    
-    void setParticleState(ParticleState state);
-    ParticleState particleState() const;
-    void setCellState(CellState state);
-    CellState cellState() const;
-
-    void setBrushSelected(bool selected);
-    bool isBrushSelected() const;
-    void setBrushOutline(bool selected);
-    bool isBrushOutline() const;
+#define X(NAME) #NAME,
+    TRAVERSAL_MODE_LIST
+#undef X
+};
 
-    void markForRedraw();
+// Inclusive run of cells [x0, x1] in row y
+struct CellSpan
+{
+    int y, x0, x1;
+};
 
-private:
-    ParticleGrid* m_particleGrid;
-    ParticleState m_particleState;
-    CellState m_cellState;
+// A rectangle of cells copied out of a ParticleGrid, one plane per field in row order
+struct CellRegion
+{
+    int width { 0 };
+    int height { 0 };
+    std::vector<ParticleType> type;
+    std::vector<ParticlePhase> phase;
+    std::vector<float> temperature;
+    std::vector<float> temperatureDelta;
+    std::vector<float> latentHeat;
+
+    void resize(int w, int h);
+};
 
-    bool m_needsRedraw;
-    bool m_isBrushSelected;
-    bool m_isBrushOutline;
-    
-    friend class ParticleGrid;
+// Milliseconds spent in each pass of ParticleGrid::update()
+struct UpdateTimings
+{
+    float movementMs { 0.f };
+    float heatMs { 0.f };
+    float phaseMs { 0.f };
+};
 
+// Frame pipeline timings from the last draw(), in milliseconds
+struct RenderPipelineStats
+{
+    // Building layer pixels from the snapshot
+    float produceMs { 0.f };
+    // Main thread blocked on the render thread
+    float waitMs { 0.f };
+    float uploadMs { 0.f };
+    // From publishing a snapshot to uploading the pixels built from it
+    float latencyMs { 0.f };
 };
+
 struct ParticleGrid
 {
-    ParticleGrid(int w, int h, SDL_Renderer* renderer);
-    ~ParticleGrid(); 
+    // With a null renderer the grid runs headless: draw() still builds the layer pixels, read them with composeFrame()
+    ParticleGrid(int w, int h, SDL_Renderer* renderer, uint64_t seed = 0);
+    ~ParticleGrid();
     
     const int width;
     const int height;
 
-    Cell* getCell(int x, int y);
+    // Cells are addressed by their index into the storage planes (y * width + x)
+    bool inBounds(int x, int y) const { return x >= 0 && x < width && y >= 0 && y < height; }
+    // Returns -1 if (x, y) is outside the grid
+    int cellIndex(int x, int y) const { return inBounds(x, y) ? y * width + x : -1; }
+    int cellX(int idx) const { return idx % width; }
+    int cellY(int idx) const { return idx / width; }
+
+    ParticleType cellType(int idx) const { return m_type[idx]; }
+    ParticlePhase cellPhase(int idx) const { return m_phase[idx]; }
+    float cellTemperature(int idx) const { return m_temperature[idx]; }
+
+    ParticleState particleState(int idx) const;
+    void setParticleState(int idx, ParticleState state);
+    // Region edits. Regions are clipped to the grid and cells already holding the state are skipped. Redraw bits
+    // are set a word at a time and the chunks around the changed cells are woken once per region (once per chunk
+    // row for span lists, which may come in any order), instead of once per cell as setParticleState() does
+    // setParticleState() over the inclusive run [x0, x1] of row y
+    void fillSpan(int y, int x0, int x1, ParticleState state);
+    void fillSpans(const std::vector<CellSpan>& spans, ParticleState state);
+    void fillRect(const DirtyRect& rect, ParticleState state);
+    // Fills the cells of a maskWidth x maskHeight byte mask placed with its corner at (x, y) where the mask is non-zero
+    void fillMask(int x, int y, int maskWidth, int maskHeight, const uint8_t* mask, ParticleState state);
+    // Adds delta to the temperature delta of each cell, as painting heat does
+    void addTemperatureDelta(const DirtyRect& rect, float delta);
+    void addTemperatureDelta(const std::vector<CellSpan>& spans, float delta);
+    // Copies rect into out, resized to the part of rect inside the grid
+    void copyRegion(const DirtyRect& rect, CellRegion& out) const;
+    // Writes region with its corner at (x, y), every field included
+    void pasteRegion(const CellRegion& region, int x, int y);
+    void swapParticles(int a, int b);
+
+    void setBrushSelected(int idx, bool selected);
+    // setBrushSelected() over the inclusive run [x0, x1] of row y, which must lie inside the grid
+    void setBrushSelectedSpan(int y, int x0, int x1, bool selected);
+    bool isBrushSelected(int idx) const { return m_flags[idx] & CellFlags::BrushSelected; }
+
+    // Redraws every cell layer of a cell (particle colour, glow and thermal) on the next draw()
+    void markForRedraw(int idx);
+    void markAllForRedraw();
+    // Wakes the chunks around a cell so the next update() simulates it
+    void wakeCell(int idx) { m_chunks.wakeCell(cellX(idx), cellY(idx)); }
+    int awakeChunkCount() const { return m_chunks.awakeCount(); }
+    int chunkCount() const { return m_chunks.count(); }
+
+    // Workers used by update(), including the calling thread
+    void setThreadCount(int threadCount);
+    int threadCount() const;
+
+    void setTraversalMode(TraversalMode mode);
+    TraversalMode traversalMode() const;
+
+    // Every random roll in update() derives from this seed, so the same seed and edits reproduce a run exactly
+    void setSeed(uint64_t seed);
+    uint64_t seed() const;
     
+    // Builds and uploads pixels only for the cells in the camera view; cells off screen stay marked until they show
     void draw();
+    // Blends the visible layers into out (width * height pixels) on the CPU, the same way draw() stacks them.
+    // Cells outside the camera view keep the pixels they had when last on screen
+    void composeFrame(uint32_t* out) const;
+    Camera& camera() { return m_camera; }
+    const Camera& camera() const { return m_camera; }
+    // With the render thread on, draw() uploads the pixels built from the previous frame's snapshot and hands the
+    // render thread the current one, so building pixels overlaps the next update(). Frames show one step late
+    void setRenderThreadEnabled(bool enabled);
+    bool renderThreadEnabled() const { return m_renderThread.joinable(); }
+    const RenderPipelineStats& renderPipelineStats() const { return m_renderStats; }
     void update();
+    // Wall time of each pass in the last update()
+    const UpdateTimings& lastUpdateTimings() const { return m_lastUpdateTimings; }
+    // Cell layer pixels recomputed and texture pixels uploaded by the last draw()
+    int lastRedrawnCells() const { return m_redrawnCells; }
+    int lastUploadedPixels() const { return m_uploadedPixels; }
+    // Layer textures created so far, over all layers
+    int textureCount() const;
+    // Fills every plane in one pass and marks the whole grid for redraw
     void clear(ParticleType type = ParticleType::Air);
 
     float ambientTemperature { 22.f };
@@ -78,13 +189,100 @@ struct ParticleGrid
     Util::TemperatureColorMode tempColorMode() const;
 
 private:
-    std::vector<Cell> m_particles;
-    std::vector<std::pair<int, int>> m_coords;
-    std::vector<Cell*> m_redrawCells;
+    // Storage planes, one entry per cell
+    std::vector<ParticleType> m_type;
+    std::vector<ParticlePhase> m_phase;
+    std::vector<float> m_temperature;
+    std::vector<float> m_temperatureDelta;
+    std::vector<float> m_latentHeat;
+    std::vector<uint8_t> m_flags;
+    std::vector<uint8_t> m_colorVariation;
+
+    // Per-worker scratch, indexed by ThreadPool::currentWorker()
+    std::vector<std::vector<int>> m_coords;
+    Palette m_palette;
+    // Layers, bottom to top. The renderer blends them, so toggling a view only changes which ones are drawn
+    RenderLayer m_particleLayer;
+    RenderLayer m_glowLayer;
+    RenderLayer m_thermalLayer;
+    RenderLayer m_brushLayer;
+    // One bit per cell in storage order: type changed (particle layer), temperature changed (glow and thermal)
+    std::vector<uint64_t> m_colorRedrawBits;
+    std::vector<uint64_t> m_heatRedrawBits;
+    // Cells whose brush selection changed; only the brush tool edits these, from the main thread
+    std::vector<int> m_brushRedrawCells;
+    bool m_thermalRebuildPending { false };
+    int m_redrawnCells { 0 };
+    int m_uploadedPixels { 0 };
+
+    // Everything the pixel producer reads. draw() copies the changed spans of the planes into it and swaps the
+    // redraw bitmaps in, so the simulation and the producer never touch the same memory
+    struct RenderSnapshot
+    {
+        std::vector<ParticleType> type;
+        std::vector<float> temperature;
+        std::vector<uint64_t> colorRedrawBits;
+        std::vector<uint64_t> heatRedrawBits;
+        // (cell, selected)
+        std::vector<std::pair<int, bool>> brushCells;
+        Util::TemperatureColorMode tempColorMode { Util::TemperatureColorMode::Infrared };
+        bool rebuildThermal { false };
+        // Cells the producer builds pixels for; marks outside it stay set for a later frame
+        DirtyRect view;
+        std::chrono::steady_clock::time_point publishTime;
+
+        // Written by the producer
+        int redrawnCells { 0 };
+        float produceMs { 0.f };
+    };
+    RenderSnapshot m_snapshot;
+    RenderPipelineStats m_renderStats;
+
+    // Single producer thread. Handoff is two counters: draw() bumps m_publishedFrame once the snapshot is
+    // written, the producer bumps m_producedFrame once the layers are built; both sides wait on the atomics
+    std::thread m_renderThread;
+    std::atomic<uint64_t> m_publishedFrame { 0 };
+    std::atomic<uint64_t> m_producedFrame { 0 };
+    std::atomic<bool> m_renderThreadStop { false };
+    // Heat exchange kernel; owns the per-cell delta buffer between frames
+    HeatDiffusion m_heat;
+    // Per-worker phase pass scratch: stage 1 results for one chunk row, and the cells queued for stage 2
+    struct PhaseScratch
+    {
+        std::vector<uint8_t> rowFlags;
+        // Temperature deltas of the row as stored before stage 1 added this step's heat
+        std::vector<float> rowStoredDeltas;
+        std::vector<int> transitionCells;
+        std::vector<float> storedDeltas;
+    };
+    std::vector<PhaseScratch> m_phaseScratch;
+
+    ChunkMap m_chunks;
+    float m_lastAmbientTemperature;
+
+    ThreadPool m_threadPool;
+    std::vector<int> m_phaseChunks;
+    // Chunk rows with at least one thermally awake chunk; each is one band of the heat and phase passes
+    std::vector<int> m_thermalBands;
+    UpdateTimings m_lastUpdateTimings;
+
+    TraversalMode m_traversalMode { TraversalMode::RandomRows };
+
+    uint64_t m_seed;
+    // Number of update() calls since the seed was set; picks each frame's random streams
+    uint64_t m_frame { 0 };
+
+    void updateChunk(int chunk, int worker);
+    // Traversal strategies over a chunk's dirty rect
+    void traverseShuffle(const DirtyRect& rect, Rng& rng, int worker);
+    void traverseSerpentine(const DirtyRect& rect, Rng& rng);
+    void traverseRandomRows(const DirtyRect& rect, Rng& rng);
+    void updateHeat(int chunk);
+    void updatePhases(int chunk, int worker);
+    void applyPhaseTransition(int idx, float storedDelta);
 
-    SDL_Texture* m_streamingTexture;
     SDL_Renderer* m_renderer;
-    SDL_FRect m_rendererRect;
+    Camera m_camera;
 
     bool m_showBrushHighlight { true };
     bool m_showTemperature { false };
@@ -92,55 +290,74 @@ private:
     // Mode for displaying heat colors
     Util::TemperatureColorMode m_tempColorMode { Util::TemperatureColorMode::Infrared };
 
-    void updateCell(int x, int y);
-    void update_b2t();
-    void update_t2b();
+    void markColorRedraw(int idx);
+    void markHeatRedraw(int idx);
+    // Overwrites the cells of the inclusive run [first, last] that differ from state and widens changed to cover them
+    void fillRun(int first, int last, const ParticleState& state, DirtyRect& changed);
+    void addTemperatureDeltaRun(int first, int last, float delta);
+    // Wakes the chunks around changed, then resets it
+    void wakeChanged(DirtyRect& changed);
+    // Changed cells of a span list edit, one rect per chunk row
+    std::vector<DirtyRect> m_bandChanges;
+    void wakeChangedBands();
+    void publishSnapshot();
+    void producePixels();
+    void waitForProducer() const;
+    void uploadAndRender();
+    void renderThreadLoop();
+    void updateCell(int x, int y, Rng& rng);
 
     friend class Brush;
-    friend class Cell;
+    friend class Snapshot;
 
 };
 
 // Update Funcs //
 struct ParticleUpdate
 {
-    Cell* nextCell;
+    // Index of the cell to move/swap with, -1 if none
+    int nextCell;
     enum ParticleUpdateMode
     {
         Move,
         Swap,
+        // Stayed put by chance; keeps the cell's chunk awake
+        Wait,
         NOOP
     } mode;
 };
-constexpr ParticleUpdate doNothing { .nextCell = nullptr, .mode = ParticleUpdate::NOOP };
+constexpr ParticleUpdate doNothing { .nextCell = -1, .mode = ParticleUpdate::NOOP };
+constexpr ParticleUpdate doWait { .nextCell = -1, .mode = ParticleUpdate::Wait };
 
-inline ParticleUpdate particleUpdateFunc_Solid(ParticleGrid* particleGrid, int x, int y)
+inline ParticleUpdate particleUpdateFunc_Solid(ParticleGrid* particleGrid, Rng& rng, int x, int y)
 {
-    Cell* cell = particleGrid->getCell(x, y);
-    if (cell == nullptr)
+    int cell = particleGrid->cellIndex(x, y);
+    if (cell < 0)
     {
         return doNothing;
     }
 
-    ParticleState particleState = cell->particleState();
-    const ParticleProperties& props = kParticleProperties.at(particleState.type);
+    const ParticleType cellType = particleGrid->cellType(cell);
+    const ParticleProperties& props = particleProperties(cellType);
     if (!props.affectedByGravity) { return doNothing; }
 
-    Cell* cellNext = nullptr;
+    int cellNext = -1;
+    // Set when a move was open but the roll declined it
+    bool restless = false;
 
     #define TRY_UPDATE() \
     do { \
-        if (cellNext) \
+        if (cellNext >= 0) \
         { \
-            int rand = std::rand(); \
-            switch (cellNext->particleState().type) \
+            ParticleType nextType = particleGrid->cellType(cellNext); \
+            switch (nextType) \
             { \
             case ParticleType::Air: \
-                if (rand % 15 == 0) { break; } \
+                if (rng.oneIn(15)) { restless |= nextType != cellType; break; } \
                 return { .nextCell = cellNext, .mode = ParticleUpdate::Swap }; \
                 break; \
             case ParticleType::Water: \
-                if (rand % 3 == 0) { break; } \
+                if (rng.oneIn(3)) { restless |= nextType != cellType; break; } \
                 return { .nextCell = cellNext, .mode = ParticleUpdate::Swap }; \
                 break; \
             default: \
@@ -150,179 +367,166 @@ inline ParticleUpdate particleUpdateFunc_Solid(ParticleGrid* particleGrid, int x
     } while (0)
 
     // Down
-    cellNext = particleGrid->getCell(x, y + 1);
+    cellNext = particleGrid->cellIndex(x, y + 1);
     TRY_UPDATE();
         
     // Left/right diag
     int dir = x % 2 ? 1 : -1;
-    cellNext = particleGrid->getCell(x + dir, y + 1);
+    cellNext = particleGrid->cellIndex(x + dir, y + 1);
     TRY_UPDATE();
 
     // Left/right diag
-    cellNext = particleGrid->getCell(x - dir, y + 1);
+    cellNext = particleGrid->cellIndex(x - dir, y + 1);
     TRY_UPDATE();
 
     #undef TRY_UPDATE
 
-    return doNothing;
+    return restless ? doWait : doNothing;
 }
-inline ParticleUpdate particleUpdateFunc_Liquid(ParticleGrid* particleGrid, int x, int y)
+inline ParticleUpdate particleUpdateFunc_Liquid(ParticleGrid* particleGrid, Rng& rng, int x, int y)
 {
-    Cell* cell = particleGrid->getCell(x, y);
-    if (cell == nullptr)
+    int cell = particleGrid->cellIndex(x, y);
+    if (cell < 0)
     {
         return doNothing;
     }
-    const ParticleProperties& cellProps = kParticleProperties.at(cell->particleState().type);
-
-    Cell* cellNext = nullptr;
+    const ParticleType cellType = particleGrid->cellType(cell);
+    const ParticleProperties& cellProps = particleProperties(cellType);
 
-    #define TRY_UPDATE() \
-    do { \
-        if (cellNext) \
-        { \
-            const ParticleProperties& props = kParticleProperties.at(cellNext->particleState().type);\
-            int rand = std::rand(); \
-            switch (cellNext->particleState().type) \
-            { \
-            case ParticleType::Air: \
-                if (rand % 30 == 0) { break; } \
-                return { .nextCell = cellNext, .mode = ParticleUpdate::Swap }; \
-                break; \
-            default: \
-                break; \
-            } \
-        } \
-    } while (0)
+    int cellNext = -1;
+    // Set when a move was open but the roll declined it
+    bool restless = false;
 
-    auto tryUpdate = [&](Cell* nextCell) -> bool {
-        if (nextCell == nullptr) return false;
+    auto tryUpdate = [&](int nextCell, int nextY) -> bool {
+        if (nextCell < 0) return false;
 
-        ParticleType type = nextCell->particleState().type;
-        const ParticleProperties& nextCellProps = kParticleProperties.at(type);
-        int rand = std::rand();
+        ParticleType type = particleGrid->cellType(nextCell);
+        const ParticleProperties& nextCellProps = particleProperties(type);
         if (type == ParticleType::Air)
         {
-            if (rand % 30 == 0) return false;
+            if (rng.oneIn(30)) { restless |= type != cellType; return false; }
             else return true;
         }
 
-        if (cellNext->particleState().phase == ParticlePhase::Liquid && type != cell->particleState().type)
+        if (particleGrid->cellPhase(nextCell) == ParticlePhase::Liquid && type != cellType)
         {
             if (nextCellProps.density == cellProps.density) return true;
-            if (nextCellProps.density < cellProps.density && nextCell->y > cell->y) return true;
-            if (nextCell->y == cell->y && rand % 3 == 0) return true;
+            if (nextCellProps.density < cellProps.density && nextY > y) return true;
+            if (nextY == y)
+            {
+                if (rng.oneIn(3)) return true;
+                restless = true;
+            }
         }
 
         return false;
     };
 
     // Down
-    cellNext = particleGrid->getCell(x, y + 1);
-    if (tryUpdate(cellNext)) return { .nextCell = cellNext, .mode = ParticleUpdate::Swap } ;
-    //TRY_UPDATE();
+    cellNext = particleGrid->cellIndex(x, y + 1);
+    if (tryUpdate(cellNext, y + 1)) return { .nextCell = cellNext, .mode = ParticleUpdate::Swap };
         
     // diag
-    int dir = std::rand() % 2 ? 1 : -1;
-    cellNext = particleGrid->getCell(x + dir, y + 1);
-    if (tryUpdate(cellNext)) return { .nextCell = cellNext, .mode = ParticleUpdate::Swap } ;//TRY_UPDATE();
+    int dir = rng.coin() ? 1 : -1;
+    cellNext = particleGrid->cellIndex(x + dir, y + 1);
+    if (tryUpdate(cellNext, y + 1)) return { .nextCell = cellNext, .mode = ParticleUpdate::Swap };
 
-    cellNext = particleGrid->getCell(x - dir, y + 1);
-    if (tryUpdate(cellNext)) return { .nextCell = cellNext, .mode = ParticleUpdate::Swap } ;//TRY_UPDATE();
+    cellNext = particleGrid->cellIndex(x - dir, y + 1);
+    if (tryUpdate(cellNext, y + 1)) return { .nextCell = cellNext, .mode = ParticleUpdate::Swap };
 
     // horizontal
-    cellNext = particleGrid->getCell(x + dir, y);
-    if (tryUpdate(cellNext)) return { .nextCell = cellNext, .mode = ParticleUpdate::Swap } ;//TRY_UPDATE();
+    cellNext = particleGrid->cellIndex(x + dir, y);
+    if (tryUpdate(cellNext, y)) return { .nextCell = cellNext, .mode = ParticleUpdate::Swap };
 
-    cellNext = particleGrid->getCell(x - dir, y);
-    if (tryUpdate(cellNext)) return { .nextCell = cellNext, .mode = ParticleUpdate::Swap } ;//TRY_UPDATE();
+    cellNext = particleGrid->cellIndex(x - dir, y);
+    if (tryUpdate(cellNext, y)) return { .nextCell = cellNext, .mode = ParticleUpdate::Swap };
 
-    #undef TRY_UPDATE
-
-    return doNothing;
+    return restless ? doWait : doNothing;
 }
-inline ParticleUpdate particleUpdateFunc_Gas(ParticleGrid* particleGrid, int x, int y)
+inline ParticleUpdate particleUpdateFunc_Gas(ParticleGrid* particleGrid, Rng& rng, int x, int y)
 {
-    Cell* cell = particleGrid->getCell(x, y);
-    if (cell == nullptr)
+    int cell = particleGrid->cellIndex(x, y);
+    if (cell < 0)
     {
-        return { .nextCell = nullptr, .mode = ParticleUpdate::NOOP };
+        return doNothing;
     }
 
-    Cell* cellNext = nullptr;
+    int cellNext = -1;
 
-    int rand = std::rand();
-    switch (rand % 3)
+    switch (rng.bounded(3))
     {
     case 0:
-        cellNext = particleGrid->getCell(x, y - 1);
+        cellNext = particleGrid->cellIndex(x, y - 1);
         break;
     
     case 1:
-        cellNext = particleGrid->getCell(x - 1, y - 1);
+        cellNext = particleGrid->cellIndex(x - 1, y - 1);
         break;
 
     case 2:
-        cellNext = particleGrid->getCell(x + 1, y - 1);
+        cellNext = particleGrid->cellIndex(x + 1, y - 1);
         break;
 
     case 3:
-        cellNext = particleGrid->getCell(x - 1, y);
+        cellNext = particleGrid->cellIndex(x - 1, y);
         break;
 
     case 4:
-        cellNext = particleGrid->getCell(x + 1, y);
+        cellNext = particleGrid->cellIndex(x + 1, y);
         break;
 
     case 5:
-        cellNext = particleGrid->getCell(x - 1, y + 1);
-        if (cellNext && cellNext->particleState().phase == ParticlePhase::Liquid)
+        cellNext = particleGrid->cellIndex(x - 1, y + 1);
+        if (cellNext >= 0 && particleGrid->cellPhase(cellNext) == ParticlePhase::Liquid)
         {
-            cellNext = nullptr;
+            cellNext = -1;
         }
         break;
 
     case 6:
-        cellNext = particleGrid->getCell(x + 1, y + 1);
-        if (cellNext && cellNext->particleState().phase == ParticlePhase::Liquid)
+        cellNext = particleGrid->cellIndex(x + 1, y + 1);
+        if (cellNext >= 0 && particleGrid->cellPhase(cellNext) == ParticlePhase::Liquid)
         {
-            cellNext = nullptr;
+            cellNext = -1;
         }
         break;
 
     default:
-        cellNext = nullptr;
+        cellNext = -1;
         break;
 
     }
 
-    if (!cellNext)
+    const ParticleType cellType = particleGrid->cellType(cell);
+    auto canRiseInto = [&](int nextCell) -> bool {
+        if (nextCell < 0) return false;
+        ParticlePhase nextPhase = particleGrid->cellPhase(nextCell);
+        return nextPhase == ParticlePhase::Gas || nextPhase == ParticlePhase::Liquid;
+    };
+
+    if (canRiseInto(cellNext) && particleGrid->cellType(cellNext) != cellType)
+    {
+        return { .nextCell = cellNext, .mode = ParticleUpdate::Swap };
+    }
+
+    // The roll picked a blocked or identical neighbour; stay awake if another one was open
+    for (int dx = -1; dx <= 1; ++dx)
     {
-        return { .nextCell = nullptr, .mode = ParticleUpdate::NOOP };
+        int other = particleGrid->cellIndex(x + dx, y - 1);
+        if (canRiseInto(other) && particleGrid->cellType(other) != cellType)
+        {
+            return doWait;
+        }
     }
 
-    if (cellNext->particleState().phase == ParticlePhase::Gas || cellNext->particleState().phase == ParticlePhase::Liquid)
+    if (canRiseInto(cellNext))
     {
         return { .nextCell = cellNext, .mode = ParticleUpdate::Swap };
     }
-    //else if (cellNext->particleState().type == ParticleType::Water)
-    //{
-    //    ParticleState newState = cell->particleState();
-    //    newState.temperature -= 30;
-    //    cell->setParticleState(newState);
-    //    return { .nextCell = cellNext, .mode = ParticleUpdate::Swap };
-    //}
-    //else if (cellNext->particleState().phase() == ParticlePhase::Solid)
-    //{
-    //    ParticleState newState = cell->particleState();
-    //    newState.temperature -= 20;
-    //    cell->setParticleState(newState);
-    //    return { .nextCell = cellNext, .mode = ParticleUpdate::Swap };
-    //}
-
-    return { .nextCell = nullptr, .mode = ParticleUpdate::NOOP };
+
+    return doNothing;
 }
-inline ParticleUpdate particleUpdateFunc_Static(ParticleGrid* particleGrid, int x, int y)
+inline ParticleUpdate particleUpdateFunc_Static(ParticleGrid* particleGrid, Rng& rng, int x, int y)
 {
     return doNothing;
 }
@@ -1,7 +1,9 @@
 #pragma once
 
-#include <unordered_map>
+#include <array>
+#include <limits>
 #include <string>
+#include <cstdint>
 #include "util.h"
 
 
@@ -11,11 +13,12 @@
     X(Gas) \
     X(Static)
 
-enum class ParticlePhase
+enum class ParticlePhase : uint8_t
 {
 #define X(NAME) NAME,
     PARTICLE_PHASE_LIST
 #undef X
+    COUNT
 };
 constexpr std::string kParticlePhaseNames[] = 
 {
@@ -23,28 +26,29 @@ constexpr std::string kParticlePhaseNames[] =
     PARTICLE_PHASE_LIST
 #undef X
 };
+// X(NAME, PROPERTIES)
 #define PARTICLE_LIST \
-    X(Sand) \
-    X(Stone) \
-    X(Crucible) \
-    X(Water) \
-    X(Gravel) \
-    X(Dirt) \
-    X(Blue) \
-    X(Pink) \
-    X(Rainbow) \
-    X(Air) 
-
-enum class ParticleType
+    X(Sand, kSandProperties) \
+    X(Stone, kStoneProperties) \
+    X(Crucible, kCrucibleProperties) \
+    X(Water, kWaterProperties) \
+    X(Gravel, kSandProperties) \
+    X(Dirt, kSandProperties) \
+    X(Blue, kSandProperties) \
+    X(Pink, kSandProperties) \
+    X(Rainbow, kSandProperties) \
+    X(Air, kAirProperties) 
+
+enum class ParticleType : uint8_t
 {
-#define X(NAME) NAME,
+#define X(NAME, PROPS) NAME,
     PARTICLE_LIST
 #undef X
     COUNT
 };
 constexpr std::string kParticleTypeNames[] = 
 {
-#define X(NAME) #NAME,
+#define X(NAME, PROPS) #NAME,
     PARTICLE_LIST
 #undef X
 };
@@ -114,18 +118,52 @@ constexpr ParticleProperties kAirProperties {
     .density = 0.0012f
 };
 
-static const std::unordered_map<ParticleType, ParticleProperties> kParticleProperties {
-    { ParticleType::Sand, kSandProperties },
-    { ParticleType::Stone, kStoneProperties },
-    { ParticleType::Crucible, kCrucibleProperties },
-    { ParticleType::Water, kWaterProperties },
-    { ParticleType::Gravel, kSandProperties },
-    { ParticleType::Dirt, kSandProperties },
-    { ParticleType::Blue, kSandProperties },
-    { ParticleType::Pink, kSandProperties },
-    { ParticleType::Rainbow, kSandProperties },
-    { ParticleType::Air, kAirProperties },
+// Indexed by ParticleType
+constexpr auto kParticleProperties = std::to_array<ParticleProperties>({
+#define X(NAME, PROPS) PROPS,
+    PARTICLE_LIST
+#undef X
+});
+static_assert(kParticleProperties.size() == static_cast<size_t>(ParticleType::COUNT), 
+              "Every ParticleType needs a ParticleProperties entry in PARTICLE_LIST");
+
+constexpr const ParticleProperties& particleProperties(ParticleType type)
+{
+    return kParticleProperties[static_cast<size_t>(type)];
+}
+
+// Open temperature interval in which a particle of a given type and phase can't start a phase change
+struct PhaseStableRange
+{
+    float low;
+    float high;
+
+    constexpr bool contains(float temperature) const { return temperature > low && temperature < high; }
 };
+// Indexed by [ParticleType][ParticlePhase]
+constexpr auto kPhaseStableRanges = [] {
+    constexpr float kInf = std::numeric_limits<float>::infinity();
+
+    std::array<std::array<PhaseStableRange, static_cast<size_t>(ParticlePhase::COUNT)>, static_cast<size_t>(ParticleType::COUNT)> ranges {};
+    for (size_t type = 0; type < ranges.size(); ++type)
+    {
+        const ParticleProperties& props = kParticleProperties[type];
+        ranges[type][static_cast<size_t>(ParticlePhase::Solid)]  = { -kInf, props.meltingPoint };
+        ranges[type][static_cast<size_t>(ParticlePhase::Liquid)] = { props.meltingPoint, props.boilingPoint };
+        ranges[type][static_cast<size_t>(ParticlePhase::Gas)]    = { props.boilingPoint, kInf };
+        ranges[type][static_cast<size_t>(ParticlePhase::Static)] = { -kInf, kInf };
+    }
+    return ranges;
+}();
+// 1 / specificHeat, indexed by ParticleType
+constexpr auto kInverseSpecificHeat = [] {
+    std::array<float, static_cast<size_t>(ParticleType::COUNT)> inverse {};
+    for (size_t type = 0; type < inverse.size(); ++type)
+    {
+        inverse[type] = 1.f / kParticleProperties[type].specificHeat;
+    }
+    return inverse;
+}();
 
 struct ParticleState
 {
@@ -143,7 +181,7 @@ struct ParticleState
 };
 static ParticlePhase getParticlePhase(ParticleType type, float temperature)
 {
-    const ParticleProperties& props = kParticleProperties.at(type);
+    const ParticleProperties& props = particleProperties(type);
     if (temperature < props.meltingPoint)
     {
         return ParticlePhase::Solid;
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "camera.h"
+#include "chunk_map.h"
+
+
+// Forward Declarations //
+struct SDL_Renderer;
+struct SDL_Texture;
+struct SDL_Rect;
+//////////////////////////
+// One grid-sized layer of pixels with a CPU copy, backed by a grid of streaming textures of up to kTextureSize
+// cells a side so no texture exceeds the renderer's limit. Writes go to pixels() and are flagged with markCell();
+// upload() then copies only the touched regions, tracked as one rect per kTileSize square tile.
+// Textures are created the first time they come into view, so memory follows what has been looked at
+class RenderLayer
+{
+public:
+    // Blended layers are drawn over the ones below by their alpha; opaque ones replace them.
+    // A null renderer makes a headless layer: no textures, upload() and render() do nothing
+    RenderLayer(SDL_Renderer* renderer, int width, int height, bool blended);
+    ~RenderLayer();
+    RenderLayer(const RenderLayer&) = delete;
+    RenderLayer& operator=(const RenderLayer&) = delete;
+
+    static constexpr int kTileSize { ChunkMap::kChunkSize };
+    // Edge of each texture in cells, lowered to a multiple of kTileSize if the renderer's limit is smaller
+    static constexpr int kTextureSize { 512 };
+
+    uint32_t* pixels() { return m_pixels.data(); }
+    const uint32_t* pixels() const { return m_pixels.data(); }
+
+    void markCell(int x, int y) { m_tileRects[(y / kTileSize) * m_tilesX + x / kTileSize].include(x, y, x, y); }
+    // Marks an inclusive cell rect. upload() sends each tile row's marks as one region, so a rect can sit in one tile
+    void markRect(int x0, int y0, int x1, int y1) { m_tileRects[(y0 / kTileSize) * m_tilesX + x0 / kTileSize].include(x0, y0, x1, y1); }
+    void markAll() { markRect(0, 0, m_width - 1, m_height - 1); }
+
+    // Creates the textures under view, then copies the marked regions to the textures that exist and returns
+    // the number of pixels uploaded. Marks accumulate until the next upload, so a hidden layer can skip
+    // uploads and catch up later
+    int upload(const DirtyRect& view);
+    // Draws the textures under view, placed on screen by the camera
+    void render(const DirtyRect& view, const Camera& camera) const;
+
+    int textureCount() const;
+
+private:
+    const int m_width;
+    const int m_height;
+    const int m_tilesX;
+    const int m_tilesY;
+
+    SDL_Renderer* m_renderer;
+    const bool m_blended;
+
+    // Textures in row-major order, null until first in view
+    int m_textureSize { kTextureSize };
+    int m_texturesX { 0 };
+    int m_texturesY { 0 };
+    std::vector<SDL_Texture*> m_textures;
+
+    std::vector<uint32_t> m_pixels;
+    std::vector<DirtyRect> m_tileRects;
+
+    // Texture cells covered by an inclusive cell rect
+    DirtyRect texturesIn(const DirtyRect& cells) const;
+    DirtyRect textureCells(int tx, int ty) const;
+    // Copies the cells of region, which must lie inside texture (tx, ty)
+    int uploadRegion(int tx, int ty, const SDL_Rect& region);
+
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+
+// Run-length coding for storage planes as (uint16 run, value) pairs. Values are compared bytewise, so -0.f and
+// NaNs round-trip
+namespace Rle
+{
+    template <typename T>
+    void encode(std::vector<uint8_t>& out, const T* values, size_t count)
+    {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(values);
+        for (size_t i = 0; i < count;)
+        {
+            uint16_t run = 1;
+            while (i + run < count && run < UINT16_MAX && std::memcmp(&values[i + run], &values[i], sizeof(T)) == 0) ++run;
+
+            const uint8_t* runBytes = reinterpret_cast<const uint8_t*>(&run);
+            out.insert(out.end(), runBytes, runBytes + sizeof(run));
+            out.insert(out.end(), bytes + i * sizeof(T), bytes + (i + 1) * sizeof(T));
+            i += run;
+        }
+    }
+
+    // Decodes count values from the runs in [in, end). Returns the end of the runs read, or null if they are
+    // truncated, empty or overrun count
+    template <typename T>
+    const uint8_t* decode(const uint8_t* in, const uint8_t* end, T* values, size_t count)
+    {
+        for (size_t i = 0; i < count;)
+        {
+            if (end - in < static_cast<ptrdiff_t>(sizeof(uint16_t) + sizeof(T))) return nullptr;
+            uint16_t run;
+            std::memcpy(&run, in, sizeof(run));
+            if (run == 0 || run > count - i) return nullptr;
+            T value;
+            std::memcpy(&value, in + sizeof(run), sizeof(T));
+            in += sizeof(run) + sizeof(T);
+            std::fill_n(values + i, run, value);
+            i += run;
+        }
+        return in;
+    }
+}
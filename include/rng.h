@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+
+// xoshiro128** generator, seeded through splitmix64. Small enough to keep one per chunk or worker
+class Rng
+{
+public:
+    using result_type = uint32_t;
+
+    explicit Rng(uint64_t seed = 0) { reseed(seed); }
+
+    void reseed(uint64_t seed)
+    {
+        uint64_t a = splitmix64(seed);
+        uint64_t b = splitmix64(seed);
+        m_state[0] = static_cast<uint32_t>(a);
+        m_state[1] = static_cast<uint32_t>(a >> 32);
+        m_state[2] = static_cast<uint32_t>(b);
+        m_state[3] = static_cast<uint32_t>(b >> 32);
+    }
+
+    uint32_t next()
+    {
+        const uint32_t result = rotl(m_state[1] * 5, 7) * 9;
+        const uint32_t t = m_state[1] << 9;
+
+        m_state[2] ^= m_state[0];
+        m_state[3] ^= m_state[1];
+        m_state[1] ^= m_state[2];
+        m_state[0] ^= m_state[3];
+        m_state[2] ^= t;
+        m_state[3] = rotl(m_state[3], 11);
+
+        return result;
+    }
+
+    // Uniform in [0, bound) using a multiply-shift instead of a division
+    uint32_t bounded(uint32_t bound) { return static_cast<uint32_t>((static_cast<uint64_t>(next()) * bound) >> 32); }
+    // True with probability 1/n
+    bool oneIn(uint32_t n) { return bounded(n) == 0; }
+    bool coin() { return next() >> 31; }
+
+    // UniformRandomBitGenerator, so it works with std::shuffle
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+    result_type operator()() { return next(); }
+
+    // Derives an independent stream seed, e.g. from (world seed, frame, chunk)
+    static uint64_t streamSeed(uint64_t seed, uint64_t a, uint64_t b = 0)
+    {
+        uint64_t state = seed ^ (a * 0x9E3779B97F4A7C15ull);
+        state = splitmix64(state) ^ b;
+        return splitmix64(state);
+    }
+
+private:
+    uint32_t m_state[4];
+
+    static uint32_t rotl(uint32_t x, int k) { return (x << k) | (x >> (32 - k)); }
+    static uint64_t splitmix64(uint64_t& state)
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+
+// Forward Declarations //
+struct ParticleGrid;
+struct SDL_Renderer;
+//////////////////////////
+// Versioned binary world file: grid size, ambient temperature, seed and frame, then the type, phase, temperature,
+// temperature delta and latent heat planes in storage order. The type plane is optionally run-length encoded;
+// the other planes are stored raw and 4-byte aligned, so loading maps the file and copies each plane out of the
+// mapping in one go. Files use host byte order and are rejected on a host of the other order
+class Snapshot
+{
+public:
+    static constexpr uint32_t kVersion { 1 };
+
+    // Writes canvas to path. Returns false and describes the failure in error
+    static bool save(const ParticleGrid& canvas, const std::filesystem::path& path, bool compressTypes, std::string& error);
+    // Builds a new grid drawn with renderer (null for headless) from the file at path. Returns null and describes
+    // the failure in error if the file is missing, truncated or from another version
+    static std::unique_ptr<ParticleGrid> load(const std::filesystem::path& path, SDL_Renderer* renderer, std::string& error);
+
+};
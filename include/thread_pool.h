@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Fixed set of workers with per-worker task queues; idle workers steal from the back of the others' queues.
+// The thread calling parallelFor() takes part as worker 0.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of workers, including the calling thread
+    int threadCount() const;
+    void setThreadCount(int threadCount);
+
+    // Runs fn(task, worker) for every task in [0, taskCount) and returns once all of them are done
+    void parallelFor(int taskCount, const std::function<void(int task, int worker)>& fn);
+
+    // Index of the pool worker running on this thread, 0 outside of a pool
+    static int currentWorker();
+    // Largest thread count the platform supports
+    static int maxThreadCount();
+    // False on builds that can't start threads at all (Emscripten without pthreads)
+    static bool threadsSupported();
+
+private:
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+
+    int m_threadCount;
+    std::vector<std::thread> m_threads;
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+
+    const std::function<void(int, int)>* m_job { nullptr };
+    std::atomic<int> m_remaining { 0 };
+
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wakeCondition;
+    uint64_t m_generation { 0 };
+    bool m_stopping { false };
+
+    void startWorkers();
+    void stopWorkers();
+    void workerLoop(int worker);
+    // Pops from the worker's own queue, then tries to steal; returns false when every queue is empty
+    bool nextTask(int worker, int& task);
+    void runTasks(int worker);
+
+};
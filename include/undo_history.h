@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "chunk_map.h"
+
+
+// Forward Declarations //
+struct ParticleGrid;
+//////////////////////////
+// Undo stack that saves only the chunks an edit touches. The first time an open edit records a cell, the
+// kChunkSize square chunk around it is copied (copy-on-write), so an edit costs O(area touched) whatever the
+// grid size. Saved chunks are optionally run-length encoded, and the oldest edits are evicted to keep the total
+// under a memory budget. Undo restores the touched chunks only; the rest of the grid keeps simulating
+class UndoHistory
+{
+public:
+    static constexpr int kChunkSize { ChunkMap::kChunkSize };
+    static constexpr size_t kDefaultMemoryBudget { 64ull << 20 };
+
+    void setCanvas(ParticleGrid* canvas);
+
+    // Opens an edit; ends the one already open, if any
+    void beginEdit();
+    // Saves the chunk holding idx if the open edit hasn't yet. Call before changing the cell; ignored with no edit open
+    void record(int idx);
+    // record() for the inclusive run [x0, x1] of row y, one call per chunk it crosses
+    void recordSpan(int y, int x0, int x1);
+    // record() for every chunk overlapping an inclusive cell rect, clipped to the grid
+    void recordRect(const DirtyRect& rect);
+    // Closes the open edit. Edits that recorded nothing are dropped
+    void endEdit();
+    bool editOpen() const { return m_editOpen; }
+
+    // Restores the chunks saved by the latest edit and drops it. Returns false if there is nothing to undo
+    bool undo();
+    void clear();
+
+    // Evicts the oldest edits right away if the new budget is lower
+    void setMemoryBudget(size_t bytes);
+    size_t memoryBudget() const { return m_memoryBudget; }
+    // Applies to chunks saved from now on
+    void setCompression(bool enabled) { m_compress = enabled; }
+    bool compression() const { return m_compress; }
+
+    size_t memoryUsage() const { return m_memoryUsage; }
+    int editCount() const { return static_cast<int>(m_edits.size()); }
+
+private:
+    // One chunk's cells as they were before the edit: type, phase, temperature, delta and latent heat planes
+    struct ChunkSave
+    {
+        int chunk;
+        bool compressed;
+        std::vector<uint8_t> data;
+    };
+    struct Edit
+    {
+        std::vector<ChunkSave> chunks;
+        size_t bytes { 0 };
+    };
+
+    ParticleGrid* m_canvas { nullptr };
+    int m_chunksX { 0 };
+
+    std::deque<Edit> m_edits;
+    bool m_editOpen { false };
+    // Per chunk, the serial of the last edit that saved it; the open edit is m_editSerial
+    std::vector<uint32_t> m_savedBy;
+    uint32_t m_editSerial { 0 };
+
+    size_t m_memoryBudget { kDefaultMemoryBudget };
+    size_t m_memoryUsage { 0 };
+    bool m_compress { true };
+
+    ChunkSave saveChunk(int chunk) const;
+    void restoreChunk(const ChunkSave& save);
+    // Drops the oldest edits until the history fits the budget, always keeping the newest (possibly open) one
+    void evict();
+
+};
@@ -9,7 +9,29 @@
 
 namespace Util
 {
-    uint32_t blendRGBA(uint32_t a, uint32_t b);
+    // Blends b over a by b's alpha; the result is opaque. Integer only: x / 255 == (x + 1 + (x >> 8)) >> 8
+    // for every x up to 255 * 255, and red and blue share one multiply in separate 16-bit lanes
+    inline uint32_t blendRGBA(uint32_t a, uint32_t b)
+    {
+        const uint32_t alpha = b & 0xFF;
+        const uint32_t invAlpha = 255 - alpha;
+
+        uint32_t rb = ((a >> 8) & 0x00FF00FF) * invAlpha + ((b >> 8) & 0x00FF00FF) * alpha;
+        uint32_t g = ((a >> 16) & 0xFF) * invAlpha + ((b >> 16) & 0xFF) * alpha;
+        rb = ((rb + 0x00010001 + ((rb >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+        g = (g + 1 + (g >> 8)) >> 8;
+
+        return (rb << 8) | (g << 16) | 0xFF;
+    }
+
+    // Composes count pixels: out = base, then glow, thermal and highlight blended over it in that order.
+    // thermal and highlight may be null to skip them; a fully transparent layer pixel leaves the colour as is.
+    // Uses AVX2, SSE2 or WASM SIMD when the build enables them; every path matches blendRGBA() exactly
+    void composeRow(uint32_t* out, const uint32_t* base, const uint32_t* glow, const uint32_t* thermal,
+                    const uint32_t* highlight, int count);
+    // Scalar reference for composeRow()
+    void composeRowScalar(uint32_t* out, const uint32_t* base, const uint32_t* glow, const uint32_t* thermal,
+                          const uint32_t* highlight, int count);
 
     inline uint32_t lerpColor(uint32_t c1, uint32_t c2, float t)
     {
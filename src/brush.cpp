@@ -5,8 +5,6 @@
 
 #include <cmath>
 #include <iostream>
-#include <queue>
-#include <unordered_set>
 
 
 Brush::Brush(int radius, ParticleType particleType)
@@ -20,17 +18,30 @@ Brush::Brush(int radius, ParticleType particleType)
     , m_particleType(particleType)
     , m_particleType2(ParticleType::Air)
     , m_canvas(nullptr)
-    , m_hoveredCell(nullptr)
+    , m_hoveredCell(-1)
 {
 
 }
 
-void Brush::handleEvent(SDL_Event* event, bool isUiFocused)
+void Brush::handleEvent(SDL_Event* event, bool isUiFocused, bool isUiTyping)
 {
     switch (event->type)
     {
     case SDL_EVENT_MOUSE_BUTTON_DOWN:
-        pushCanvasState();
+        // The first button pressed over the canvas opens the edit; others join it until that button is released
+        if (!isUiFocused && event->button.button >= 1 && event->button.button <= 3 && m_editButton == 0)
+        {
+            m_editButton = event->button.button;
+            m_history.beginEdit();
+            // A new stroke starts where it was pressed rather than joining the last one
+            if (!m_isDown && !m_isHeatDown)
+            {
+                m_strokePath.clear();
+                m_strokeX = m_x;
+                m_strokeY = m_y;
+                m_strokeStarted = false;
+            }
+        }
         switch (event->button.button)
         {
         case 1:
@@ -69,6 +80,13 @@ void Brush::handleEvent(SDL_Event* event, bool isUiFocused)
         break;
 
     case SDL_EVENT_MOUSE_BUTTON_UP:
+        // Paint what the cursor swept since the last update() before the stroke ends
+        if (m_isDown || m_isHeatDown) paintStroke();
+        if (event->button.button == m_editButton)
+        {
+            m_editButton = 0;
+            m_history.endEdit();
+        }
         switch (event->button.button)
         {
         case 1:
@@ -102,7 +120,12 @@ void Brush::handleEvent(SDL_Event* event, bool isUiFocused)
         //                    % static_cast<int>(BrushType::COUNT);
         //    setBrushType(static_cast<BrushType>(nextIdx));
         //}
-        if (SDL_GetModState() & SDL_KMOD_CTRL)
+        if (SDL_GetModState() & SDL_KMOD_ALT)
+        {
+            // Alt + scroll zooms the camera
+            break;
+        }
+        else if (SDL_GetModState() & SDL_KMOD_CTRL)
         {
             int nextIdx = (static_cast<int>(m_particleType) + static_cast<int>(event->wheel.y) + static_cast<int>(ParticleType::COUNT)) 
                             % static_cast<int>(ParticleType::COUNT);
@@ -125,30 +148,27 @@ void Brush::handleEvent(SDL_Event* event, bool isUiFocused)
         break;
 
     case SDL_EVENT_MOUSE_MOTION:
-    {
-        int x = (event->motion.x / m_canvas->m_rendererRect.w) * m_canvas->width;
-        int y = (event->motion.y / m_canvas->m_rendererRect.h) * m_canvas->height;
-        if (x != m_x || y != m_y)
-        {
-            setPos(x, y);
-            m_hoveredCell = m_canvas->getCell(x, y);
-        }
+        m_mouseX = event->motion.x;
+        m_mouseY = event->motion.y;
+        refreshHover();
         break;
-    }
 
     case SDL_EVENT_KEY_DOWN:
+        if (isUiTyping) break;
         switch (event->key.key)
         {
         case SDLK_F:
             if (event->key.mod & SDL_KMOD_ALT) break;
-            pushCanvasState();
+            // A fill during a stroke joins the stroke's edit
+            if (m_editButton == 0) m_history.beginEdit();
             floodFill();
+            if (m_editButton == 0) m_history.endEdit();
             break;
 
         case SDLK_Z:
             if (event->key.mod & SDL_KMOD_CTRL)
             {
-                popCanvasState();
+                m_history.undo();
             }
 
         }
@@ -162,6 +182,11 @@ void Brush::handleEvent(SDL_Event* event, bool isUiFocused)
 void Brush::setCanvas(ParticleGrid* canvas)
 {
     m_canvas = canvas;
+    m_history.setCanvas(canvas);
+    m_selectedSpans.clear();
+    // An index into the old grid may be past the end of this one
+    m_hoveredCell = -1;
+    updateStamp();
 }
 
 void Brush::setParticleType(ParticleType type)
@@ -173,66 +198,28 @@ void Brush::setBrushType(BrushType type)
     if (m_brushType == type) { return; }
 
     m_brushType = type;
-    switch (type)
-    {
-    default:
-    case BrushType::Circle:
-        setShapeCircle();
-        break;
-
-    case BrushType::Square:
-        setShapeSquare();
-        break;
-    }
+    updateStamp();
 }
 void Brush::setRadius(int radius)
 {
     if (m_radius == radius) { return; }
 
     m_radius = radius;
-    switch (m_brushType)
-    {
-    default:
-    case BrushType::Circle:
-        setShapeCircle();
-        break;
-
-    case BrushType::Square:
-        setShapeSquare();
-        break;
-    }
+    updateStamp();
 }
 void Brush::setRotation(float radians)
 {
     if (m_rot == radians) { return; }
 
     m_rot = radians;
-    switch (m_brushType)
-    {
-    default:
-    case BrushType::Circle:
-        break;
-
-    case BrushType::Square:
-        setShapeSquare();
-        break;
-    }
+    updateStamp();
 }
 void Brush::setPos(int x, int y)
 {
     m_x = x;
     m_y = y;
-    switch (m_brushType)
-    {
-    default:
-    case BrushType::Circle:
-        setShapeCircle();
-        break;
-
-    case BrushType::Square:
-        setShapeSquare();
-        break;
-    }
+    placeStamp();
+    if (m_isDown || m_isHeatDown) m_strokePath.emplace_back(x, y);
 }
 
 ParticleType Brush::particleType() const
@@ -251,248 +238,318 @@ float Brush::rotation() const
 {
     return m_rot;
 }
-Cell* Brush::hoveredCell() const
+int Brush::hoveredCell() const
 {
     return m_hoveredCell;
 }
+void Brush::refreshHover()
+{
+    int x, y;
+    m_canvas->camera().screenToCell(m_mouseX, m_mouseY, x, y);
+    if (x != m_x || y != m_y)
+    {
+        setPos(x, y);
+    }
+    // Recomputed even when (x, y) is unchanged, since the canvas may have been swapped for one of another width
+    m_hoveredCell = m_canvas->cellIndex(x, y);
+}
 
 void Brush::toggleHighlight()
 {
     m_canvas->m_showBrushHighlight = !m_canvas->m_showBrushHighlight;
-    for (Cell* cell : m_shape.outline)
-    {
-        cell->markForRedraw();
-    }
 }
 bool Brush::highlight() const
 {
     return m_canvas->m_showBrushHighlight;
 }
 
-void Brush::pushCanvasState()
+Brush::Stamp Brush::buildStamp(BrushType type, int radius, int rotationStep)
 {
-    std::vector<CompoundState> canvasState;
-    canvasState.reserve(m_canvas->width * m_canvas->height);
-    for (const Cell& cell : m_canvas->m_particles)
+    // Plot the outline into a local mask with a one-cell margin, then take the cells the centre reaches
+    // without crossing it, as the old flood fill from the centre did
+    // A rotated square's corners reach radius * sqrt(2) from the centre
+    const int reach = type == BrushType::Square ? static_cast<int>(std::ceil(radius * 1.41422f)) : radius;
+    const int centre = reach + 1;
+    const int size = 2 * centre + 1;
+    enum : uint8_t { Empty, Outline, Inside };
+    std::vector<uint8_t> mask(size * size, Empty);
+    auto plot = [&](int x, int y) {
+        x += centre;
+        y += centre;
+        if (x >= 0 && x < size && y >= 0 && y < size) mask[y * size + x] = Outline;
+    };
+
+    switch (type)
+    {
+    default:
+    case BrushType::Circle:
     {
-        canvasState.emplace_back(cell.particleState(), cell.cellState());
+        // Midpoint circle
+        int x = 0;
+        int y = radius;
+        int d = 1 - y;  // Decision variable
+        while (x <= y)
+        {
+            plot(x, y);   plot(-x, y);  plot(x, -y);  plot(-x, -y);
+            plot(y, x);   plot(-y, x);  plot(y, -x);  plot(-y, -x);
+            if (d < 0)
+            {
+                d += 2 * x + 3;
+            }
+            else
+            {
+                d += 2 * (x - y) + 5;
+                y--;
+            }
+            x++;
+        }
+        break;
     }
-    m_canvasStateStack.push(std::move(canvasState));
-}
-void Brush::popCanvasState()
-{
-    if (m_canvasStateStack.empty()) return;
 
-    size_t canvasSize = m_canvas->width * m_canvas->height;
-    std::vector<CompoundState>& canvasState = m_canvasStateStack.top();
-    if (canvasState.size() == canvasSize)
+    case BrushType::Square:
     {
-        int i = 0;
-        for (Cell& cell : m_canvas->m_particles)
+        static constexpr int vertices[4][2] = { { 1, 1 }, { -1, 1 }, { -1, -1 }, { 1, -1 } };
+        const float rot = rotationStep * (Util::PI / 2.f) / kRotationSteps;
+        const float c = std::cos(rot);
+        const float s = std::sin(rot);
+        auto corner = [&](int i, int& x, int& y) {
+            const auto [vx, vy] = vertices[i % 4];
+            x = static_cast<int>(std::round((vx * c - vy * s) * radius));
+            y = static_cast<int>(std::round((vx * s + vy * c) * radius));
+        };
+        for (int i = 0; i < 4; ++i)
         {
-            CompoundState compoundState = canvasState[i];
-            cell.setParticleState(compoundState.particleState);
-            cell.setCellState(compoundState.cellState);
-            ++i;
+            int x1, y1, x2, y2;
+            corner(i, x1, y1);
+            corner(i + 1, x2, y2);
+            Util::bresenhamLine(x1, y1, x2, y2, plot);
         }
+        break;
     }
-    else
-    {
-        std::cerr << __func__ << ": Canvas state size (" << canvasState.size() << ") does not match current canvas size (" << canvasSize << " [" << m_canvas->width << "x" << m_canvas->height << "]); discarding\n";
+
     }
-    m_canvasStateStack.pop();
-}
 
-void Brush::setShapeCircle()
-{
-    for (Cell* cell : m_shape.outline)
+    // 4-connected fill from the centre; the outline is 8-connected, so nothing leaks through its diagonals
+    std::vector<int> stack { centre * size + centre };
+    while (!stack.empty())
     {
-        cell->setBrushOutline(false);
+        const int cell = stack.back();
+        stack.pop_back();
+        if (mask[cell] != Empty) continue;
+        mask[cell] = Inside;
+
+        const int x = cell % size;
+        const int y = cell / size;
+        if (x + 1 < size) stack.push_back(cell + 1);
+        if (x > 0)        stack.push_back(cell - 1);
+        if (y + 1 < size) stack.push_back(cell + size);
+        if (y > 0)        stack.push_back(cell - size);
     }
-    m_shape.outline.clear();
-    m_shape.x = m_x;
-    m_shape.y = m_y;
-
-    int x = 0;
-    int y = m_radius;
-    int d = 1 - y;  // Decision variable
 
-    while (x <= y) 
+    Stamp stamp;
+    for (int y = 0; y < size; ++y)
     {
-        auto tryPush = [&](int x, int y) {
-            Cell* c = m_canvas->getCell(x, y);
-            if (c) 
-            { 
-                c->setBrushOutline(true);
-                m_shape.outline.insert(c);
-            }
-        };
-
-        tryPush(m_x + x, m_y + y);
-        tryPush(m_x - x, m_y + y);
-        tryPush(m_x + x, m_y - y);
-        tryPush(m_x - x, m_y - y);
-        tryPush(m_x + y, m_y + x);
-        tryPush(m_x - y, m_y + x);
-        tryPush(m_x + y, m_y - x);
-        tryPush(m_x - y, m_y - x);
-
-        if (d < 0) 
+        for (int x = 0; x < size; ++x)
         {
-            d += 2 * x + 3;
-        } 
-        else 
-        {
-            d += 2 * (x - y) + 5;
-            y--;
+            if (mask[y * size + x] != Inside) continue;
+            const int x0 = x;
+            while (x + 1 < size && mask[y * size + x + 1] == Inside) ++x;
+            stamp.push_back({ y - centre, x0 - centre, x - centre });
         }
-        x++;
     }
-
-    selectFill();
+    return stamp;
 }
-void Brush::setShapeSquare()
+void Brush::updateStamp()
 {
-    for (Cell* cell : m_shape.outline)
+    int rotationStep = 0;
+    if (m_brushType == BrushType::Square)
     {
-        cell->setBrushOutline(false);
+        const float quarterTurn = Util::PI / 2.f;
+        const float rot = std::fmod(std::fmod(m_rot, quarterTurn) + quarterTurn, quarterTurn);
+        rotationStep = static_cast<int>(std::lround(rot / quarterTurn * kRotationSteps)) % kRotationSteps;
     }
-    m_shape.outline.clear();
-    m_shape.x = m_x;
-    m_shape.y = m_y;
-
-    auto tryPush = [&](int x, int y) {
-        Cell* c = m_canvas->getCell(x, y);
-        if (c) 
-        { 
-            c->setBrushOutline(true);
-            m_shape.outline.insert(c);
-        }
-    };
 
-    static const std::vector<std::pair<int, int>> vertices = {
-        { 1, 1 },
-        { -1, 1 },
-        { -1, -1 },
-        { 1, -1 }
-    };
-    static const int nVertices = vertices.size();
+    const uint32_t key = static_cast<uint32_t>(m_brushType) << 24 | static_cast<uint32_t>(m_radius) << 8 | static_cast<uint32_t>(rotationStep);
+    auto it = m_stampCache.find(key);
+    if (it == m_stampCache.end())
+    {
+        it = m_stampCache.emplace(key, buildStamp(m_brushType, m_radius, rotationStep)).first;
+    }
+    m_stamp = &it->second;
+    placeStamp();
+}
+void Brush::placeStamp()
+{
+    if (!m_canvas) return;
 
-    for (int i = 0; i < nVertices; ++i)
+    for (const Span& span : m_selectedSpans)
     {
-        auto [vx, vy] = vertices[i];
-        auto [nx, ny] = vertices[(i + 1) % nVertices];
-
-        // Rotate and scale first point
-        float x1f = vx * std::cos(m_rot) - vy * std::sin(m_rot);
-        float y1f = vx * std::sin(m_rot) + vy * std::cos(m_rot);
-        x1f *= m_radius;
-        y1f *= m_radius;
-
-        // Rotate and scale next point
-        float x2f = nx * std::cos(m_rot) - ny * std::sin(m_rot);
-        float y2f = nx * std::sin(m_rot) + ny * std::cos(m_rot);
-        x2f *= m_radius;
-        y2f *= m_radius;
-
-        // Translate and round to nearest integer pixel
-        int x1 = static_cast<int>(std::round(m_shape.x + x1f));
-        int y1 = static_cast<int>(std::round(m_shape.y + y1f));
-        int x2 = static_cast<int>(std::round(m_shape.x + x2f));
-        int y2 = static_cast<int>(std::round(m_shape.y + y2f));
-
-        Util::bresenhamLine(x1, y1, x2, y2, [&](int x, int y) {
-            tryPush(x, y);
-        });
+        m_canvas->setBrushSelectedSpan(span.y, span.x0, span.x1, false);
     }
+    m_selectedSpans.clear();
 
-    selectFill();
+    // Like the old fill from the centre, a brush centred off the canvas selects nothing
+    if (!m_stamp || !m_canvas->inBounds(m_x, m_y)) return;
+    for (const Span& span : *m_stamp)
+    {
+        const int y = m_y + span.y;
+        const int x0 = std::max(m_x + span.x0, 0);
+        const int x1 = std::min(m_x + span.x1, m_canvas->width - 1);
+        if (y < 0 || y >= m_canvas->height || x0 > x1) continue;
+
+        m_canvas->setBrushSelectedSpan(y, x0, x1, true);
+        m_selectedSpans.push_back({ y, x0, x1 });
+    }
 }
 
 void Brush::update()
 {
-    if (m_isDown)
+    if (m_isDown || m_isHeatDown)
     {
-        for (Cell* cell : m_selectedCells)
+        paintStroke();
+    }
+    else
+    {
+        m_strokePath.clear();
+        m_strokeStarted = false;
+    }
+}
+void Brush::sweepStroke()
+{
+    m_strokeSpans.clear();
+    auto stampAt = [this](int cx, int cy) {
+        if (!m_canvas->inBounds(cx, cy)) return;
+        for (const Span& span : *m_stamp)
         {
-            cell->setParticleState(defaultParticleState(m_particleType, m_canvas->ambientTemperature));
+            const int y = cy + span.y;
+            const int x0 = std::max(cx + span.x0, 0);
+            const int x1 = std::min(cx + span.x1, m_canvas->width - 1);
+            if (y >= 0 && y < m_canvas->height && x0 <= x1) m_strokeSpans.push_back({ y, x0, x1 });
         }
+    };
+
+    // Stamp every cell of the path from the last painted position through the queued samples, one cell apart so
+    // nothing is skipped however far the cursor jumped
+    int fromX = m_strokeX;
+    int fromY = m_strokeY;
+    stampAt(fromX, fromY);
+    for (auto [toX, toY] : m_strokePath)
+    {
+        if (toX == fromX && toY == fromY) continue;
+        Util::bresenhamLine(fromX, fromY, toX, toY, [&](int x, int y) {
+            if (x != fromX || y != fromY) stampAt(x, y);
+        });
+        fromX = toX;
+        fromY = toY;
     }
-    
-    if (m_isHeatDown)
+    m_strokePath.clear();
+
+    // Merge into disjoint spans, so each cell is written once however many stamps covered it
+    std::sort(m_strokeSpans.begin(), m_strokeSpans.end(), [](const Span& a, const Span& b) {
+        return a.y != b.y ? a.y < b.y : a.x0 < b.x0;
+    });
+    size_t merged = 0;
+    for (size_t i = 1; i < m_strokeSpans.size(); ++i)
     {
-        for (Cell* cell : m_selectedCells)
+        Span& last = m_strokeSpans[merged];
+        const Span& span = m_strokeSpans[i];
+        if (span.y == last.y && span.x0 <= last.x1 + 1)
+        {
+            last.x1 = std::max(last.x1, span.x1);
+        }
+        else
         {
-            ParticleState state = cell->particleState();
-            state.temperatureDelta += SDL_GetModState() & SDL_KMOD_SHIFT ? -5.f : 5.f;
-            cell->setParticleState(state);
+            m_strokeSpans[++merged] = span;
         }
     }
+    if (!m_strokeSpans.empty()) m_strokeSpans.resize(merged + 1);
 }
-
-void Brush::selectFill()
+void Brush::paintStroke()
 {
-    for (Cell* cell : m_selectedCells)
+    if (!m_stamp) return;
+
+    // Holding the brush still keeps painting the stamp under it, which is already clipped and merged
+    const bool moved = !m_strokePath.empty() || !m_strokeStarted;
+    if (moved) sweepStroke();
+    const std::vector<Span>& spans = moved ? m_strokeSpans : m_selectedSpans;
+    m_strokeX = m_x;
+    m_strokeY = m_y;
+    m_strokeStarted = true;
+
+    if (!m_isDown && !m_isHeatDown) return;
+    for (const Span& span : spans)
     {
-        cell->setBrushSelected(false);
+        m_history.recordSpan(span.y, span.x0, span.x1);
     }
-    m_selectedCells.clear();
-
-    std::queue<Cell*> q;
-    std::unordered_set<Cell*> visited;
-    Cell* cell = m_canvas->getCell(m_shape.x, m_shape.y);
-    if (cell == nullptr)
+    if (m_isDown)
     {
-        return;
+        m_canvas->fillSpans(spans, defaultParticleState(m_particleType, m_canvas->ambientTemperature));
     }
-    q.push(cell);
-
-    while (!q.empty())
+    if (m_isHeatDown)
     {
-        cell = q.front();
-        q.pop();
-        if (visited.contains(cell) || cell->isBrushOutline()) continue;
-
-        cell->setBrushSelected(true);
-        m_selectedCells.push_back(cell);
-        visited.insert(cell);
-
-        auto tryPush = [&](int x, int y) {
-            Cell* c = m_canvas->getCell(x, y);
-            if (c) { q.push(c); }
-        };
-
-        tryPush(cell->x + 1, cell->y);
-        tryPush(cell->x - 1, cell->y);
-        tryPush(cell->x, cell->y + 1);
-        tryPush(cell->x, cell->y - 1);
+        m_canvas->addTemperatureDelta(spans, SDL_GetModState() & SDL_KMOD_SHIFT ? -5.f : 5.f);
     }
 }
+
 void Brush::floodFill()
 {
-    std::queue<Cell*> q;
-    Cell* cell = m_canvas->getCell(m_x, m_y);
-    if (cell == nullptr)
+    const int start = m_canvas->cellIndex(m_x, m_y);
+    if (start < 0)
     {
         std::cerr << "Invalid brush position [" << m_x << ", " << m_y << "]\n";
         return;
     }
-    q.push(cell);
-    ParticleType target = cell->particleState().type;
+    const ParticleType target = m_canvas->cellType(start);
+    if (target == m_particleType) return;
+
+    // Scanline fill: find every span of the 4-connected target region first, then write them in bulk.
+    // visited has one bit per cell, so the search never re-reads a span it already took
+    const int width = m_canvas->width;
+    const int height = m_canvas->height;
+    std::vector<uint64_t> visited((static_cast<size_t>(width) * height + 63) / 64, 0);
+    auto fillable = [&](int x, int y) {
+        const int idx = y * width + x;
+        return !(visited[idx >> 6] >> (idx & 63) & 1) && m_canvas->cellType(idx) == target;
+    };
+    auto visit = [&](int y, int x0, int x1) {
+        for (int idx = y * width + x0; idx <= y * width + x1; ++idx)
+        {
+            visited[idx >> 6] |= uint64_t(1) << (idx & 63);
+        }
+    };
 
-    while (!q.empty())
+    std::vector<Span> spans;
+    std::vector<std::pair<int, int>> seeds { { m_x, m_y } };
+    while (!seeds.empty())
     {
-        cell = q.front();
-        q.pop();
-        if (cell == nullptr || cell->particleState().type == m_particleType) continue;
-
-        if (cell->particleState().type == target)
+        const auto [x, y] = seeds.back();
+        seeds.pop_back();
+        if (!fillable(x, y)) continue;
+
+        int x0 = x;
+        int x1 = x;
+        while (x0 > 0 && fillable(x0 - 1, y)) --x0;
+        while (x1 + 1 < width && fillable(x1 + 1, y)) ++x1;
+        visit(y, x0, x1);
+        spans.push_back({ y, x0, x1 });
+
+        // One seed per run of fillable cells touching the span from above or below
+        for (const int ny : { y - 1, y + 1 })
         {
-            cell->setParticleState(defaultParticleState(m_particleType, m_canvas->ambientTemperature));
-            q.push(m_canvas->getCell(cell->x + 1, cell->y));
-            q.push(m_canvas->getCell(cell->x - 1, cell->y));
-            q.push(m_canvas->getCell(cell->x, cell->y + 1));
-            q.push(m_canvas->getCell(cell->x, cell->y - 1));
+            if (ny < 0 || ny >= height) continue;
+            bool inRun = false;
+            for (int nx = x0; nx <= x1; ++nx)
+            {
+                const bool open = fillable(nx, ny);
+                if (open && !inRun) seeds.emplace_back(nx, ny);
+                inRun = open;
+            }
         }
     }
-}
\ No newline at end of file
+
+    for (const Span& span : spans)
+    {
+        m_history.recordSpan(span.y, span.x0, span.x1);
+    }
+    m_canvas->fillSpans(spans, defaultParticleState(m_particleType, m_canvas->ambientTemperature));
+}
@@ -0,0 +1,83 @@
+#include "camera.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+Camera::Camera(int gridWidth, int gridHeight, float viewportWidth, float viewportHeight)
+    : m_gridWidth(gridWidth)
+    , m_gridHeight(gridHeight)
+    , m_viewportWidth(viewportWidth)
+    , m_viewportHeight(viewportHeight)
+{
+    reset();
+}
+
+void Camera::setViewport(float width, float height)
+{
+    m_viewportWidth = width;
+    m_viewportHeight = height;
+    m_zoom = std::clamp(m_zoom, minZoom(), std::max(kMaxZoom, minZoom()));
+    clampView();
+}
+void Camera::reset()
+{
+    m_zoom = minZoom();
+    m_x = 0.f;
+    m_y = 0.f;
+    clampView();
+}
+void Camera::zoomAt(float factor, float screenX, float screenY)
+{
+    const float cellX = m_x + screenX / m_zoom;
+    const float cellY = m_y + screenY / m_zoom;
+    m_zoom = std::clamp(m_zoom * factor, minZoom(), std::max(kMaxZoom, minZoom()));
+    m_x = cellX - screenX / m_zoom;
+    m_y = cellY - screenY / m_zoom;
+    clampView();
+}
+void Camera::pan(float dx, float dy)
+{
+    m_x += dx / m_zoom;
+    m_y += dy / m_zoom;
+    clampView();
+}
+
+float Camera::minZoom() const
+{
+    return std::min(m_viewportWidth / m_gridWidth, m_viewportHeight / m_gridHeight);
+}
+
+void Camera::screenToCell(float screenX, float screenY, int& cellX, int& cellY) const
+{
+    cellX = static_cast<int>(std::floor(m_x + screenX / m_zoom));
+    cellY = static_cast<int>(std::floor(m_y + screenY / m_zoom));
+}
+DirtyRect Camera::visibleCells() const
+{
+    DirtyRect cells;
+    const int x0 = std::max(0, static_cast<int>(std::floor(m_x)));
+    const int y0 = std::max(0, static_cast<int>(std::floor(m_y)));
+    const int x1 = std::min(m_gridWidth, static_cast<int>(std::ceil(m_x + m_viewportWidth / m_zoom))) - 1;
+    const int y1 = std::min(m_gridHeight, static_cast<int>(std::ceil(m_y + m_viewportHeight / m_zoom))) - 1;
+    if (x0 <= x1 && y0 <= y1) cells.include(x0, y0, x1, y1);
+    return cells;
+}
+SDL_FRect Camera::screenRect(const DirtyRect& cells) const
+{
+    return {
+        .x = (cells.minX - m_x) * m_zoom,
+        .y = (cells.minY - m_y) * m_zoom,
+        .w = (cells.maxX - cells.minX + 1) * m_zoom,
+        .h = (cells.maxY - cells.minY + 1) * m_zoom
+    };
+}
+
+void Camera::clampView()
+{
+    auto clampAxis = [](float& origin, float viewCells, int gridCells) {
+        origin = viewCells >= gridCells ? (gridCells - viewCells) / 2.f : std::clamp(origin, 0.f, gridCells - viewCells);
+    };
+    clampAxis(m_x, m_viewportWidth / m_zoom, m_gridWidth);
+    clampAxis(m_y, m_viewportHeight / m_zoom, m_gridHeight);
+}
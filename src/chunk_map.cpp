@@ -0,0 +1,91 @@
+#include "chunk_map.h"
+
+#include <algorithm>
+#include <cassert>
+
+
+ChunkMap::ChunkMap(int gridWidth, int gridHeight)
+    : width((gridWidth + kChunkSize - 1) / kChunkSize)
+    , height((gridHeight + kChunkSize - 1) / kChunkSize)
+    , m_gridWidth(gridWidth)
+    , m_gridHeight(gridHeight)
+{
+    assert(gridWidth > 0 && gridHeight > 0);
+    m_chunks.resize(width * height);
+}
+
+int ChunkMap::chunkMaxX(int idx) const
+{
+    return std::min(chunkMinX(idx) + kChunkSize, m_gridWidth) - 1;
+}
+int ChunkMap::chunkMaxY(int idx) const
+{
+    return std::min(chunkMinY(idx) + kChunkSize, m_gridHeight) - 1;
+}
+
+static void setAwake(bool& flag)
+{
+    std::atomic_ref<bool>(flag).store(true, std::memory_order_relaxed);
+}
+
+void ChunkMap::wakeCell(int x, int y)
+{
+    wakeRect(x - 1, y - 1, x + 1, y + 1);
+}
+void ChunkMap::wakeRect(int x0, int y0, int x1, int y1)
+{
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, m_gridWidth - 1);
+    y1 = std::min(y1, m_gridHeight - 1);
+    if (x0 > x1 || y0 > y1) return;
+
+    for (int cy = y0 / kChunkSize; cy <= y1 / kChunkSize; ++cy)
+    {
+        for (int cx = x0 / kChunkSize; cx <= x1 / kChunkSize; ++cx)
+        {
+            const int idx = cy * width + cx;
+            Chunk& c = m_chunks[idx];
+            c.nextDirty.includeAtomic(std::max(x0, chunkMinX(idx)), std::max(y0, chunkMinY(idx)),
+                                      std::min(x1, chunkMaxX(idx)), std::min(y1, chunkMaxY(idx)));
+            setAwake(c.nextThermalAwake);
+        }
+    }
+}
+void ChunkMap::wakeThermal(int idx)
+{
+    const int cx = idx % width;
+    const int cy = idx / width;
+
+    setAwake(m_chunks[idx].nextThermalAwake);
+    if (cx > 0)          setAwake(m_chunks[idx - 1].nextThermalAwake);
+    if (cx < width - 1)  setAwake(m_chunks[idx + 1].nextThermalAwake);
+    if (cy > 0)          setAwake(m_chunks[idx - width].nextThermalAwake);
+    if (cy < height - 1) setAwake(m_chunks[idx + width].nextThermalAwake);
+}
+void ChunkMap::wakeAll()
+{
+    wakeRect(0, 0, m_gridWidth - 1, m_gridHeight - 1);
+}
+
+void ChunkMap::step()
+{
+    for (int idx = 0; idx < count(); ++idx)
+    {
+        Chunk& c = m_chunks[idx];
+        c.dirty = c.nextDirty;
+        if (c.nextThermalAwake)
+        {
+            // Gases mixing carry heat, so a chunk out of equilibrium is simulated in full
+            c.dirty.include(chunkMinX(idx), chunkMinY(idx), chunkMaxX(idx), chunkMaxY(idx));
+        }
+        c.thermalAwake = c.nextThermalAwake || !c.dirty.empty();
+        c.nextDirty.reset();
+        c.nextThermalAwake = false;
+    }
+}
+
+int ChunkMap::awakeCount() const
+{
+    return static_cast<int>(std::count_if(m_chunks.begin(), m_chunks.end(), [](const Chunk& c) { return !c.asleep(); }));
+}
@@ -0,0 +1,231 @@
+#include "frame_writer.h"
+
+#include <cstdio>
+#include <iostream>
+
+
+FrameWriter::FrameWriter(std::filesystem::path directory, FrameFormat format, int width, int height, int capacity)
+    : m_directory(std::move(directory))
+    , m_format(format)
+    , m_width(width)
+    , m_height(height)
+    , m_capacity(std::max(capacity, 1))
+{
+    m_thread = std::thread(&FrameWriter::writerLoop, this);
+}
+FrameWriter::~FrameWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_condition.notify_one();
+    m_thread.join();
+}
+
+std::vector<uint32_t> FrameWriter::acquireBuffer()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_freeBuffers.empty())
+        {
+            std::vector<uint32_t> buffer = std::move(m_freeBuffers.back());
+            m_freeBuffers.pop_back();
+            return buffer;
+        }
+    }
+    return std::vector<uint32_t>(static_cast<size_t>(m_width) * m_height);
+}
+bool FrameWriter::submit(std::vector<uint32_t>&& pixels, uint64_t frameIndex)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_queue.size() >= m_capacity)
+        {
+            ++m_dropped;
+            m_freeBuffers.push_back(std::move(pixels));
+            return false;
+        }
+        m_queue.push_back({ std::move(pixels), frameIndex });
+    }
+    m_condition.notify_one();
+    return true;
+}
+
+void FrameWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idleCondition.wait(lock, [this] { return m_queue.empty() && !m_busy; });
+}
+
+int FrameWriter::writtenCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_written;
+}
+int FrameWriter::droppedCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dropped;
+}
+int FrameWriter::failedCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_failed;
+}
+
+void FrameWriter::writerLoop()
+{
+    while (true)
+    {
+        Frame frame;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_queue.empty()) return;
+
+            frame = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_busy = true;
+        }
+
+        // Encoding and file IO happen outside the lock, so submit() only ever waits on a queue push/pop
+        const bool ok = writeFrame(frame);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++(ok ? m_written : m_failed);
+            m_freeBuffers.push_back(std::move(frame.pixels));
+            m_busy = false;
+        }
+        m_idleCondition.notify_all();
+    }
+}
+bool FrameWriter::writeFrame(const Frame& frame)
+{
+    switch (m_format)
+    {
+    case FrameFormat::Qoi:
+        encodeQoi(frame.pixels);
+        break;
+
+    case FrameFormat::Raw:
+    default:
+        encodeRaw(frame.pixels);
+        break;
+    }
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "frame_%06llu.%s", static_cast<unsigned long long>(frame.index), kFrameFormatNames[static_cast<int>(m_format)]);
+    const std::filesystem::path path = m_directory / name;
+
+    FILE* file = std::fopen(path.string().c_str(), "wb");
+    if (!file)
+    {
+        std::cerr << __func__ << ": Failed to open " << path << " for writing\n";
+        return false;
+    }
+    const bool ok = std::fwrite(m_encoded.data(), 1, m_encoded.size(), file) == m_encoded.size();
+    std::fclose(file);
+    return ok;
+}
+
+void FrameWriter::encodeRaw(const std::vector<uint32_t>& pixels)
+{
+    // Byte order R, G, B, A regardless of host endianness
+    m_encoded.resize(pixels.size() * 4);
+    uint8_t* out = m_encoded.data();
+    for (uint32_t pixel : pixels)
+    {
+        *out++ = pixel >> 24;
+        *out++ = pixel >> 16;
+        *out++ = pixel >> 8;
+        *out++ = pixel;
+    }
+}
+void FrameWriter::encodeQoi(const std::vector<uint32_t>& pixels)
+{
+    // "Quite OK Image" format, https://qoiformat.org/qoi-specification.pdf
+    constexpr uint8_t kOpIndex { 0x00 };
+    constexpr uint8_t kOpDiff  { 0x40 };
+    constexpr uint8_t kOpLuma  { 0x80 };
+    constexpr uint8_t kOpRun   { 0xC0 };
+    constexpr uint8_t kOpRgb   { 0xFE };
+    constexpr uint8_t kOpRgba  { 0xFF };
+
+    m_encoded.clear();
+    m_encoded.reserve(14 + pixels.size() * 5 + 8);
+    auto put32 = [this](uint32_t value) {
+        m_encoded.push_back(value >> 24);
+        m_encoded.push_back(value >> 16);
+        m_encoded.push_back(value >> 8);
+        m_encoded.push_back(value);
+    };
+    m_encoded.insert(m_encoded.end(), { 'q', 'o', 'i', 'f' });
+    put32(m_width);
+    put32(m_height);
+    m_encoded.push_back(4); // RGBA
+    m_encoded.push_back(0); // sRGB with linear alpha
+
+    uint32_t index[64] = {};
+    uint32_t previous = 0x000000FF;
+    int run = 0;
+    for (size_t i = 0; i < pixels.size(); ++i)
+    {
+        const uint32_t pixel = pixels[i];
+        if (pixel == previous)
+        {
+            ++run;
+            if (run == 62 || i + 1 == pixels.size())
+            {
+                m_encoded.push_back(kOpRun | (run - 1));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0)
+        {
+            m_encoded.push_back(kOpRun | (run - 1));
+            run = 0;
+        }
+
+        const uint8_t r = pixel >> 24, g = pixel >> 16, b = pixel >> 8, a = pixel;
+        const int hash = (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+        if (index[hash] == pixel)
+        {
+            m_encoded.push_back(kOpIndex | hash);
+        }
+        else
+        {
+            index[hash] = pixel;
+            const uint8_t pa = previous;
+            if (a == pa)
+            {
+                const int8_t dr = static_cast<int8_t>(r - static_cast<uint8_t>(previous >> 24));
+                const int8_t dg = static_cast<int8_t>(g - static_cast<uint8_t>(previous >> 16));
+                const int8_t db = static_cast<int8_t>(b - static_cast<uint8_t>(previous >> 8));
+                const int8_t drg = dr - dg;
+                const int8_t dbg = db - dg;
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                {
+                    m_encoded.push_back(kOpDiff | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                }
+                else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+                {
+                    m_encoded.push_back(kOpLuma | (dg + 32));
+                    m_encoded.push_back((drg + 8) << 4 | (dbg + 8));
+                }
+                else
+                {
+                    m_encoded.insert(m_encoded.end(), { kOpRgb, r, g, b });
+                }
+            }
+            else
+            {
+                m_encoded.insert(m_encoded.end(), { kOpRgba, r, g, b, a });
+            }
+        }
+        previous = pixel;
+    }
+    m_encoded.insert(m_encoded.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+}
@@ -0,0 +1,134 @@
+#include "heat_diffusion.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+
+void HeatDiffusion::resize(int width, int height)
+{
+    m_width = width;
+    m_height = height;
+    m_delta.assign(static_cast<size_t>(width) * height, 0.f);
+    m_ambientRow.assign(width, m_ambient);
+}
+void HeatDiffusion::setAmbient(float ambient)
+{
+    if (ambient != m_ambient)
+    {
+        m_ambient = ambient;
+        std::fill(m_ambientRow.begin(), m_ambientRow.end(), ambient);
+    }
+}
+
+float HeatDiffusion::cellDelta(const float* temperature, int x, int y) const
+{
+    const int idx = y * m_width + x;
+    const float ambient = m_ambient;
+    const float temp = temperature[idx];
+
+    float delta = 0.f;
+    delta += x + 1 < m_width  ? (temperature[idx + 1] - temp) * kNeighborRate       : (ambient - temp) * kAmbientRate;
+    delta += x > 0            ? (temperature[idx - 1] - temp) * kNeighborRate       : (ambient - temp) * kAmbientRate;
+    delta += y + 1 < m_height ? (temperature[idx + m_width] - temp) * kNeighborRate : (ambient - temp) * kAmbientRate;
+    delta += y > 0            ? (temperature[idx - m_width] - temp) * kNeighborRate : (ambient - temp) * kAmbientRate;
+    return delta;
+}
+
+void HeatDiffusion::computeDeltasScalar(const float* temperature, int x0, int y0, int x1, int y1)
+{
+    for (int y = y0; y <= y1; ++y)
+    {
+        for (int x = x0; x <= x1; ++x)
+        {
+            m_delta[y * m_width + x] = cellDelta(temperature, x, y);
+        }
+    }
+}
+
+void HeatDiffusion::computeDeltas(const float* temperature, int x0, int y0, int x1, int y1)
+{
+    const float* ambientRow = m_ambientRow.data();
+
+    // Columns with both horizontal neighbours inside the grid
+    const int innerX0 = std::max(x0, 1);
+    const int innerX1 = std::min(x1, m_width - 2);
+
+    for (int y = y0; y <= y1; ++y)
+    {
+        const float* row = temperature + y * m_width;
+        float* out = m_delta.data() + y * m_width;
+
+        // Rows past the grid edge read the ambient row at the lower rate
+        const float* up = y > 0 ? row - m_width : ambientRow;
+        const float* down = y + 1 < m_height ? row + m_width : ambientRow;
+        const float upRate = y > 0 ? kNeighborRate : kAmbientRate;
+        const float downRate = y + 1 < m_height ? kNeighborRate : kAmbientRate;
+
+        for (int x = x0; x < innerX0 && x <= x1; ++x)
+        {
+            out[x] = cellDelta(temperature, x, y);
+        }
+
+        int x = innerX0;
+#if defined(__AVX2__)
+        const __m256 neighborRate8 = _mm256_set1_ps(kNeighborRate);
+        const __m256 upRate8 = _mm256_set1_ps(upRate);
+        const __m256 downRate8 = _mm256_set1_ps(downRate);
+        for (; x + 7 <= innerX1; x += 8)
+        {
+            const __m256 c = _mm256_loadu_ps(row + x);
+            __m256 d = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(row + x + 1), c), neighborRate8);
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(row + x - 1), c), neighborRate8));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(down + x), c), downRate8));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(up + x), c), upRate8));
+            _mm256_storeu_ps(out + x, d);
+        }
+#endif
+#if defined(__SSE2__)
+        const __m128 neighborRate4 = _mm_set1_ps(kNeighborRate);
+        const __m128 upRate4 = _mm_set1_ps(upRate);
+        const __m128 downRate4 = _mm_set1_ps(downRate);
+        for (; x + 3 <= innerX1; x += 4)
+        {
+            const __m128 c = _mm_loadu_ps(row + x);
+            __m128 d = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(row + x + 1), c), neighborRate4);
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(row + x - 1), c), neighborRate4));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(down + x), c), downRate4));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(up + x), c), upRate4));
+            _mm_storeu_ps(out + x, d);
+        }
+#elif defined(__wasm_simd128__)
+        const v128_t neighborRate4 = wasm_f32x4_splat(kNeighborRate);
+        const v128_t upRate4 = wasm_f32x4_splat(upRate);
+        const v128_t downRate4 = wasm_f32x4_splat(downRate);
+        for (; x + 3 <= innerX1; x += 4)
+        {
+            const v128_t c = wasm_v128_load(row + x);
+            v128_t d = wasm_f32x4_mul(wasm_f32x4_sub(wasm_v128_load(row + x + 1), c), neighborRate4);
+            d = wasm_f32x4_add(d, wasm_f32x4_mul(wasm_f32x4_sub(wasm_v128_load(row + x - 1), c), neighborRate4));
+            d = wasm_f32x4_add(d, wasm_f32x4_mul(wasm_f32x4_sub(wasm_v128_load(down + x), c), downRate4));
+            d = wasm_f32x4_add(d, wasm_f32x4_mul(wasm_f32x4_sub(wasm_v128_load(up + x), c), upRate4));
+            wasm_v128_store(out + x, d);
+        }
+#endif
+        for (; x <= innerX1; ++x)
+        {
+            const float c = row[x];
+            float d = (row[x + 1] - c) * kNeighborRate;
+            d += (row[x - 1] - c) * kNeighborRate;
+            d += (down[x] - c) * downRate;
+            d += (up[x] - c) * upRate;
+            out[x] = d;
+        }
+
+        for (x = std::max(innerX1 + 1, x0); x <= x1; ++x)
+        {
+            out[x] = cellDelta(temperature, x, y);
+        }
+    }
+}
@@ -3,6 +3,12 @@
 
 #include <iostream>
 #include <ctime>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <chrono>
+#include <filesystem>
+#include <memory>
 
 #ifdef EMSCRIPTEN
 #include <emscripten.h>
@@ -11,6 +17,8 @@
 #include "particle_grid.h"
 #include "brush.h"
 #include "util.h"
+#include "frame_writer.h"
+#include "snapshot.h"
 
 #include "imgui.h"
 #include "imgui_impl_sdl3.h"
@@ -25,15 +33,39 @@ constexpr int kGridHeight { 128 };
 constexpr int kScreenWidth { kGridWidth * kCellScale };
 constexpr int kScreenHeight { kGridHeight * kCellScale };
 
+// Render rate limit for when vsync is unavailable; 0 renders as fast as possible
 constexpr int kFrameCap { 240 };
 constexpr double kFrameDuration { kFrameCap ? 1. / kFrameCap : -1 };
+
+// Simulation steps per second, independent of the render rate
+constexpr int kDefaultTickRate { 120 };
+constexpr int kMinTickRate { 10 };
+constexpr int kMaxTickRate { 480 };
+// Most steps run in one frame; a backlog past this is dropped so a slow frame can't snowball
+constexpr int kMaxCatchUpSteps { 4 };
+
+// Screen pixels the view moves per arrow key press
+constexpr float kCameraPanStep { 48.f };
 ///////////////
 
 static SDL_Window* window;
 static SDL_Renderer* renderer;
 
-static Uint64 startTime, endTime;
-static double deltaTime, fps;
+// Frame timing, all in seconds
+struct FrameStats
+{
+    double frameTime { 0. };
+    double simTime { 0. };
+    double renderTime { 0. };
+    double presentTime { 0. };
+    double idleTime { 0. };
+    int simSteps { 0 };
+    int droppedSteps { 0 };
+};
+static FrameStats frameStats;
+static Uint64 lastFrameStart;
+static double tickAccumulator;
+static double fps;
 
 static ParticleGrid* grid;
 static Brush* brush;
@@ -46,20 +78,53 @@ static bool guiShowControls { false };
 static bool guiShowFPS { true };
 
 static bool guiShowTemperature;
+static int guiThreadCount;
+static bool guiRenderThread;
+static bool guiUndoCompression;
+static int guiTickRate { kDefaultTickRate };
+static char guiSnapshotPath[256] { "world.sandtoy" };
+static std::string guiSnapshotStatus;
 
 static Uint64 freq = SDL_GetPerformanceFrequency();
 
+static double secondsSince(Uint64 start)
+{
+    return static_cast<double>(SDL_GetPerformanceCounter() - start) / freq;
+}
+
+// Swaps in the world saved at path, keeping the current grid's thread, traversal and view settings
+static bool loadWorld(const char* path, std::string& error)
+{
+    std::unique_ptr<ParticleGrid> loaded = Snapshot::load(path, renderer, error);
+    if (!loaded) return false;
+
+    loaded->setThreadCount(grid->threadCount());
+    loaded->setTraversalMode(grid->traversalMode());
+    loaded->setRenderThreadEnabled(grid->renderThreadEnabled());
+    if (loaded->showTemp() != grid->showTemp()) loaded->toggleShowTemp();
+    loaded->setTempColorMode(grid->tempColorMode());
+
+    delete grid;
+    grid = loaded.release();
+    brush->setCanvas(grid);
+    brush->refreshHover();
+    return true;
+}
+
 static bool quit { false };
 static void mainloop()
 {
-    startTime = SDL_GetPerformanceCounter();
+    const Uint64 frameStart = SDL_GetPerformanceCounter();
+    frameStats.frameTime = static_cast<double>(frameStart - lastFrameStart) / freq;
+    lastFrameStart = frameStart;
+    if (frameStats.frameTime > 0.) fps = 1. / frameStats.frameTime;
 
     // Handle Events //
     SDL_Event e;
     while (SDL_PollEvent(&e))
     {
         ImGui_ImplSDL3_ProcessEvent(&e);
-        brush->handleEvent(&e, guiIO->WantCaptureMouse);
+        brush->handleEvent(&e, guiIO->WantCaptureMouse, guiIO->WantCaptureKeyboard);
 
         switch (e.type)
         {
@@ -68,9 +133,33 @@ static void mainloop()
             quit = true;
             break;
 
+        case SDL_EVENT_MOUSE_WHEEL:
+            if ((SDL_GetModState() & SDL_KMOD_ALT) && !guiIO->WantCaptureMouse)
+            {
+                grid->camera().zoomAt(std::pow(Camera::kZoomStep, e.wheel.y), e.wheel.mouse_x, e.wheel.mouse_y);
+                brush->refreshHover();
+            }
+            break;
+
         case SDL_EVENT_KEY_DOWN:
+            // Keys typed into a text field aren't shortcuts
+            if (guiIO->WantCaptureKeyboard) break;
             switch (e.key.key)
             {
+            case SDLK_LEFT:
+            case SDLK_RIGHT:
+            case SDLK_UP:
+            case SDLK_DOWN:
+                grid->camera().pan(e.key.key == SDLK_LEFT ? -kCameraPanStep : e.key.key == SDLK_RIGHT ? kCameraPanStep : 0.f,
+                                   e.key.key == SDLK_UP ? -kCameraPanStep : e.key.key == SDLK_DOWN ? kCameraPanStep : 0.f);
+                brush->refreshHover();
+                break;
+
+            case SDLK_HOME:
+                grid->camera().reset();
+                brush->refreshHover();
+                break;
+
             case SDLK_R:
                 grid->clear();
                 break;
@@ -114,8 +203,25 @@ static void mainloop()
     ///////////////////
 
     // Update //
-    brush->update();
-    grid->update();
+    // Fixed timestep: run as many steps as real time has accumulated, up to the catch-up limit
+    const double tickDuration = 1. / guiTickRate;
+    tickAccumulator += frameStats.frameTime;
+    frameStats.simSteps = 0;
+    frameStats.droppedSteps = 0;
+    while (tickAccumulator >= tickDuration && frameStats.simSteps < kMaxCatchUpSteps)
+    {
+        brush->update();
+        grid->update();
+        tickAccumulator -= tickDuration;
+        ++frameStats.simSteps;
+    }
+    if (tickAccumulator >= tickDuration)
+    {
+        frameStats.droppedSteps = static_cast<int>(tickAccumulator / tickDuration);
+        tickAccumulator -= frameStats.droppedSteps * tickDuration;
+    }
+    frameStats.simTime = secondsSince(frameStart);
+    const Uint64 renderStart = SDL_GetPerformanceCounter();
     ////////////
 
     // Edit Sandbox //
@@ -170,6 +276,31 @@ static void mainloop()
     ImGui::Checkbox("Show controls", &guiShowControls);
     ImGui::Checkbox("Show FPS", &guiShowFPS);
 
+    ImGui::Separator();
+
+    ImGui::PushItemWidth(200.f);
+    ImGui::InputText("World file", guiSnapshotPath, sizeof(guiSnapshotPath));
+    ImGui::PopItemWidth();
+    if (ImGui::Button("Save"))
+    {
+        const Uint64 saveStart = SDL_GetPerformanceCounter();
+        std::string error;
+        guiSnapshotStatus = Snapshot::save(*grid, guiSnapshotPath, true, error)
+            ? "Saved in " + std::to_string(static_cast<int>(secondsSince(saveStart) * 1000.)) + " ms" : error;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Load"))
+    {
+        const Uint64 loadStart = SDL_GetPerformanceCounter();
+        std::string error;
+        guiSnapshotStatus = loadWorld(guiSnapshotPath, error)
+            ? "Loaded in " + std::to_string(static_cast<int>(secondsSince(loadStart) * 1000.)) + " ms" : error;
+    }
+    if (!guiSnapshotStatus.empty())
+    {
+        ImGui::TextUnformatted(guiSnapshotStatus.c_str());
+    }
+
     if (guiShowControls)
     {
         ImGui::Separator();
@@ -205,6 +336,9 @@ static void mainloop()
             CTRL_TABLE_ENTRY("Undo", "Ctrl + Z");
             CTRL_TABLE_ENTRY("Heat", "Middle Click");
             CTRL_TABLE_ENTRY("Cool", "Shift + Middle Click");
+            CTRL_TABLE_ENTRY("Zoom", "Alt + Scroll");
+            CTRL_TABLE_ENTRY("Pan", "Arrow Keys");
+            CTRL_TABLE_ENTRY("Reset view", "Home");
             
             CTRL_TABLE_SEPARATOR();
 
@@ -222,6 +356,10 @@ static void mainloop()
     {
         ImGui::Separator();
         ImGui::Text("FPS: %f", fps);
+        ImGui::Text("Sim: %.2f ms (%d steps, %d dropped)", frameStats.simTime * 1000., frameStats.simSteps, frameStats.droppedSteps);
+        ImGui::Text("Render: %.2f ms", frameStats.renderTime * 1000.);
+        ImGui::Text("Present: %.2f ms", frameStats.presentTime * 1000.);
+        ImGui::Text("Idle: %.2f ms", frameStats.idleTime * 1000.);
     }
 
     ImGui::PopItemWidth();
@@ -233,19 +371,61 @@ static void mainloop()
     ImGui::SetNextWindowPos(ImVec2(kScreenWidth - debugWindowWidth, 0.f));
     ImGui::Begin("Debug", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
 
-    ParticleState hoveredCellState = brush->hoveredCell() ? brush->hoveredCell()->particleState() : defaultParticleState(ParticleType::Air, grid->ambientTemperature);
+    ParticleState hoveredCellState = brush->hoveredCell() >= 0 ? grid->particleState(brush->hoveredCell()) : defaultParticleState(ParticleType::Air, grid->ambientTemperature);
     ImGui::SeparatorText("Hovered particle");
     ImGui::Text("Type: %s", kParticleTypeNames[static_cast<int>(hoveredCellState.type)].c_str());
     ImGui::Text("Phase: %s", kParticlePhaseNames[static_cast<int>(hoveredCellState.phase)].c_str());
     ImGui::Text("Temperature: %.2f", hoveredCellState.temperature);
 
     ImGui::SeparatorText("World");
+    ImGui::Text("Seed: %llu", static_cast<unsigned long long>(grid->seed()));
+    ImGui::Text("Awake chunks: %d/%d", grid->awakeChunkCount(), grid->chunkCount());
+    const DirtyRect view = grid->camera().visibleCells();
+    ImGui::Text("View: %dx%d cells at %.2fx", view.maxX - view.minX + 1, view.maxY - view.minY + 1, grid->camera().zoom());
+    const UpdateTimings& timings = grid->lastUpdateTimings();
+    ImGui::Text("Update: move %.2f / heat %.2f / phase %.2f ms", timings.movementMs, timings.heatMs, timings.phaseMs);
+    ImGui::Text("Redrawn cells: %d, uploaded pixels: %d", grid->lastRedrawnCells(), grid->lastUploadedPixels());
+    ImGui::Text("Layer textures: %d", grid->textureCount());
+    const RenderPipelineStats& renderStats = grid->renderPipelineStats();
+    ImGui::Text("Draw: produce %.2f / wait %.2f / upload %.2f ms", renderStats.produceMs, renderStats.waitMs, renderStats.uploadMs);
+    ImGui::Text("Frame latency: %.2f ms", renderStats.latencyMs);
+
+    ImGui::SeparatorText("Undo");
+    const UndoHistory& history = brush->history();
+    ImGui::Text("Edits: %d, memory: %.2f / %.0f MiB", history.editCount(), history.memoryUsage() / 1048576., history.memoryBudget() / 1048576.);
+    guiUndoCompression = history.compression();
+    if (ImGui::Checkbox("Compress undo", &guiUndoCompression))
+    {
+        brush->history().setCompression(guiUndoCompression);
+    }
 
     ImGui::PushItemWidth(debugWindowWidth / 2.f);
     if (ImGui::DragFloat("Ambient temp", &grid->ambientTemperature, 1.f, -273.f, 3000.f))
     {
         grid->ambientTemperature = std::min(std::max(grid->ambientTemperature, Util::kAbsZero), Util::kMaxTemp);
     }
+    if (ImGui::BeginCombo("Traversal", kTraversalModeNames[static_cast<int>(grid->traversalMode())].c_str()))
+    {
+        for (int i = 0; i < static_cast<int>(TraversalMode::COUNT); ++i)
+        {
+            if (ImGui::Selectable(kTraversalModeNames[i].c_str()))
+            {
+                grid->setTraversalMode(static_cast<TraversalMode>(i));
+            }
+        }
+        ImGui::EndCombo();
+    }
+    guiRenderThread = grid->renderThreadEnabled();
+    if (ThreadPool::threadsSupported() && ImGui::Checkbox("Render thread", &guiRenderThread))
+    {
+        grid->setRenderThreadEnabled(guiRenderThread);
+    }
+    guiThreadCount = grid->threadCount();
+    if (ImGui::SliderInt("Threads", &guiThreadCount, 1, ThreadPool::maxThreadCount()))
+    {
+        grid->setThreadCount(guiThreadCount);
+    }
+    ImGui::SliderInt("Tick rate", &guiTickRate, kMinTickRate, kMaxTickRate);
     guiShowTemperature = grid->showTemp();
     if (ImGui::Checkbox("Infrared mode", &guiShowTemperature))
     {
@@ -277,44 +457,591 @@ static void mainloop()
 
     grid->draw();
 
-    endTime = SDL_GetPerformanceCounter();
-    deltaTime = static_cast<double>(endTime - startTime) / freq;
-#ifdef EMSCRIPTEN
-    deltaTime = std::max(deltaTime, 0.001);
+    ImGui::Render();
+    ImGui_ImplSDLRenderer3_RenderDrawData(ImGui::GetDrawData(), renderer);
+    frameStats.renderTime = secondsSince(renderStart);
+
+    const Uint64 presentStart = SDL_GetPerformanceCounter();
+    SDL_RenderPresent(renderer);
+    frameStats.presentTime = secondsSince(presentStart);
+
+    // The browser paces frames itself; natively, sleep off the rest of the frame instead of spinning
+    frameStats.idleTime = 0.;
+#ifndef EMSCRIPTEN
+    const double elapsed = secondsSince(frameStart);
+    if (kFrameDuration > 0 && elapsed < kFrameDuration)
+    {
+        const Uint64 idleStart = SDL_GetPerformanceCounter();
+        SDL_DelayPrecise(static_cast<Uint64>((kFrameDuration - elapsed) * 1e9));
+        frameStats.idleTime = secondsSince(idleStart);
+    }
 #endif
-    if (kFrameDuration > 0 && deltaTime < kFrameDuration)
+}
+
+#ifndef EMSCRIPTEN
+// Headless mode: sandtoy --headless [--steps N] [--every K] [--width W] [--height H] [--seed S]
+//                                   [--threads T] [--out DIR] [--format qoi|rgba] [--queue Q]
+//                                   [--load FILE] [--save FILE]
+// Simulates a built-in scene, or the world saved in --load, without opening a window and writes every K-th frame
+// to DIR. --save writes the world as it is after the last step.
+// sandtoy --bench-fill [--width W] [--height H] [--repeat N] times flood filling a whole empty grid instead
+// sandtoy --bench-update [--steps N] [--repeat N] [--width W] [--height H] [--seed S] [--threads T]
+// times update() on the built-in scene
+// sandtoy --bench-threads takes the same options and times it with 1 to T workers
+// sandtoy --bench-heat does the same on a scene that keeps every thermal band busy
+// sandtoy --bench-draw [--steps N] [--width W] [--height H] [--seed S] times draw() redrawing the whole grid, then
+// redrawing what each update() changed
+// sandtoy --check-heat [--repeat N] [--seed S] compares the SIMD heat kernel with its scalar reference
+// sandtoy --check-blend [--repeat N] [--seed S] compares the integer and SIMD colour blends with their references
+// sandtoy --check-phase checks that the phase pass still drops the write for a cell whose state comes out unchanged
+#define HEADLESS_MODE_LIST \
+    X(Run,          "--headless")      \
+    X(BenchFill,    "--bench-fill")    \
+    X(BenchUpdate,  "--bench-update")  \
+    X(BenchThreads, "--bench-threads") \
+    X(BenchHeat,    "--bench-heat")    \
+    X(BenchDraw,    "--bench-draw")    \
+    X(CheckHeat,    "--check-heat")    \
+    X(CheckBlend,   "--check-blend")   \
+    X(CheckPhase,   "--check-phase")
+
+enum class HeadlessMode
+{
+#define X(NAME, FLAG) NAME,
+    HEADLESS_MODE_LIST
+#undef X
+    COUNT
+};
+constexpr const char* kHeadlessModeFlags[] =
+{
+#define X(NAME, FLAG) FLAG,
+    HEADLESS_MODE_LIST
+#undef X
+};
+
+static bool parseHeadlessMode(const char* arg, HeadlessMode& mode)
+{
+    for (int i = 0; i < static_cast<int>(HeadlessMode::COUNT); ++i)
     {
-        while (static_cast<double>(SDL_GetPerformanceCounter() - startTime) / freq < kFrameDuration) {}
-        deltaTime = kFrameDuration;
+        if (std::strcmp(arg, kHeadlessModeFlags[i]) == 0)
+        {
+            mode = static_cast<HeadlessMode>(i);
+            return true;
+        }
     }
-    fps = 1. / deltaTime;
+    return false;
+}
 
-    ImGui::Render();
-    ImGui_ImplSDLRenderer3_RenderDrawData(ImGui::GetDrawData(), renderer);
-    SDL_RenderPresent(renderer);
+struct HeadlessOptions
+{
+    HeadlessMode mode { HeadlessMode::Run };
+    int steps { 600 };
+    int every { 1 };
+    int repeat { 5 };
+    // 0 picks the mode's default size
+    int width { 0 };
+    int height { 0 };
+    uint64_t seed { 0 };
+    int threads { ThreadPool::maxThreadCount() };
+    std::filesystem::path out { "frames" };
+    FrameFormat format { FrameFormat::Qoi };
+    int queue { 8 };
+    std::filesystem::path load;
+    std::filesystem::path save;
+};
+
+static bool parseHeadlessOptions(int argc, char** argv, HeadlessOptions& options)
+{
+    options.seed = static_cast<uint64_t>(std::time(0));
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        HeadlessMode mode;
+        if (parseHeadlessMode(arg, mode))
+        {
+            if (mode != HeadlessMode::Run) options.mode = mode;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Missing value for " << arg << '\n';
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (std::strcmp(arg, "--steps") == 0)        options.steps = std::max(0, std::atoi(value));
+        else if (std::strcmp(arg, "--every") == 0)   options.every = std::max(1, std::atoi(value));
+        else if (std::strcmp(arg, "--repeat") == 0)  options.repeat = std::max(1, std::atoi(value));
+        else if (std::strcmp(arg, "--width") == 0)   options.width = std::max(1, std::atoi(value));
+        else if (std::strcmp(arg, "--height") == 0)  options.height = std::max(1, std::atoi(value));
+        else if (std::strcmp(arg, "--seed") == 0)    options.seed = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--threads") == 0) options.threads = std::atoi(value);
+        else if (std::strcmp(arg, "--out") == 0)     options.out = value;
+        else if (std::strcmp(arg, "--queue") == 0)   options.queue = std::max(1, std::atoi(value));
+        else if (std::strcmp(arg, "--load") == 0)    options.load = value;
+        else if (std::strcmp(arg, "--save") == 0)    options.save = value;
+        else if (std::strcmp(arg, "--format") == 0)
+        {
+            int format = 0;
+            while (format < static_cast<int>(FrameFormat::COUNT) && std::strcmp(value, kFrameFormatNames[format]) != 0) ++format;
+            if (format == static_cast<int>(FrameFormat::COUNT))
+            {
+                std::cerr << "Unknown frame format " << value << '\n';
+                return false;
+            }
+            options.format = static_cast<FrameFormat>(format);
+        }
+        else
+        {
+            std::cerr << "Unknown option " << arg << '\n';
+            return false;
+        }
+    }
+    // Benchmarks default to grids with enough chunks to keep every worker busy
+    int defaultWidth = kGridWidth;
+    int defaultHeight = kGridHeight;
+    if (options.mode == HeadlessMode::BenchFill)
+    {
+        defaultWidth = 4096;
+        defaultHeight = 4096;
+    }
+    else if (options.mode == HeadlessMode::BenchUpdate || options.mode == HeadlessMode::BenchThreads ||
+             options.mode == HeadlessMode::BenchHeat || options.mode == HeadlessMode::BenchDraw)
+    {
+        defaultWidth = 1024;
+        defaultHeight = 512;
+    }
+    if (options.width == 0) options.width = defaultWidth;
+    if (options.height == 0) options.height = defaultHeight;
+    return true;
 }
 
-int main(int argc, char** argv)
+// Sand and water blocks dropped onto a hot stone floor
+static void fillDemoScene(ParticleGrid& canvas)
+{
+    auto fillRect = [&canvas](int x0, int y0, int x1, int y1, ParticleType type, float temperature) {
+        canvas.fillRect({ .minX = x0, .minY = y0, .maxX = x1 - 1, .maxY = y1 - 1 }, defaultParticleState(type, temperature));
+    };
+    const int w = canvas.width;
+    const int h = canvas.height;
+    fillRect(0, h - h / 16 - 1, w, h, ParticleType::Stone, 400.f);
+    fillRect(w / 8, h / 8, w * 3 / 8, h * 3 / 8, ParticleType::Sand, canvas.ambientTemperature);
+    fillRect(w * 5 / 8, h / 8, w * 7 / 8, h * 3 / 8, ParticleType::Water, canvas.ambientTemperature);
+}
+
+// Solid stone in alternating hot and cold columns around a sealed pocket of water, so heat flows through every
+// chunk for thousands of steps and the water boils in place without anything moving
+static void fillHeatScene(ParticleGrid& canvas)
+{
+    const int w = canvas.width;
+    const int h = canvas.height;
+    for (int x = 0; x < w; x += 32)
+    {
+        const float temperature = (x / 32) % 2 ? 1200.f : canvas.ambientTemperature;
+        canvas.fillRect({ .minX = x, .minY = 0, .maxX = std::min(x + 31, w - 1), .maxY = h - 1 },
+                        defaultParticleState(ParticleType::Stone, temperature));
+    }
+    canvas.fillRect({ .minX = w / 4, .minY = h / 2, .maxX = w * 3 / 4, .maxY = h * 5 / 8 },
+                    defaultParticleState(ParticleType::Water, 90.f));
+}
+
+// Fills the whole grid from its centre, alternating two materials so every fill rewrites every cell
+static int runFillBenchmark(const HeadlessOptions& options)
+{
+    ParticleGrid canvas(options.width, options.height, nullptr, options.seed);
+    Brush fillBrush(Brush::kMinRadius, ParticleType::Sand);
+    fillBrush.setCanvas(&canvas);
+    fillBrush.setPos(options.width / 2, options.height / 2);
+
+    using Clock = std::chrono::steady_clock;
+    double totalMs = 0.;
+    for (int i = 0; i < options.repeat; ++i)
+    {
+        fillBrush.setParticleType(i % 2 ? ParticleType::Water : ParticleType::Sand);
+        const Clock::time_point start = Clock::now();
+        fillBrush.floodFill();
+        const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        totalMs += ms;
+        std::cout << "Fill " << i + 1 << ": " << ms << " ms\n";
+    }
+    const double cells = static_cast<double>(options.width) * options.height;
+    std::cout << options.width << "x" << options.height << " fill: " << totalMs / options.repeat << " ms average, "
+              << cells * options.repeat / (totalMs * 1000.) << " Mcells/s\n";
+    return 0;
+}
+
+// Runs HeatDiffusion::computeDeltas() and computeDeltasScalar() on random planes and rects, with widths that leave
+// SIMD tails of every length. The SIMD paths keep the scalar operation order, so the deltas must match exactly
+static int runHeatCheck(const HeadlessOptions& options)
+{
+    constexpr int kWidths[] { 1, 2, 3, 5, 7, 9, 11, 13, 15, 17, 23, 31, 33, 63, 67, 129, 255, 257 };
+    Rng rng(options.seed);
+    auto uniform = [&rng](float lo, float hi) { return lo + (hi - lo) * (rng.next() >> 8) * (1.f / (1 << 24)); };
+
+    std::vector<float> temperature;
+    HeatDiffusion simd;
+    HeatDiffusion scalar;
+    int rects = 0;
+    int mismatches = 0;
+    float maxDiff = 0.f;
+    for (int pass = 0; pass < options.repeat; ++pass)
+    {
+        for (const int width : kWidths)
+        {
+            const int height = 1 + static_cast<int>(rng.bounded(40));
+            temperature.resize(static_cast<size_t>(width) * height);
+            for (float& temp : temperature) temp = uniform(Util::kAbsZero, Util::kMaxTemp);
+
+            const float ambient = uniform(Util::kAbsZero, Util::kMaxTemp);
+            for (HeatDiffusion* diffusion : { &simd, &scalar })
+            {
+                diffusion->setAmbient(ambient);
+                diffusion->resize(width, height);
+            }
+
+            // The whole grid, then sub-rects that start and end anywhere
+            for (int i = 0; i < 8; ++i)
+            {
+                int x0 = 0, y0 = 0, x1 = width - 1, y1 = height - 1;
+                if (i > 0)
+                {
+                    x0 = static_cast<int>(rng.bounded(width));
+                    x1 = x0 + static_cast<int>(rng.bounded(width - x0));
+                    y0 = static_cast<int>(rng.bounded(height));
+                    y1 = y0 + static_cast<int>(rng.bounded(height - y0));
+                }
+                simd.computeDeltas(temperature.data(), x0, y0, x1, y1);
+                scalar.computeDeltasScalar(temperature.data(), x0, y0, x1, y1);
+                ++rects;
+
+                bool match = true;
+                for (size_t idx = 0; idx < temperature.size(); ++idx)
+                {
+                    const float diff = std::fabs(simd.deltas()[idx] - scalar.deltas()[idx]);
+                    maxDiff = std::max(maxDiff, diff);
+                    match = match && diff == 0.f;
+                }
+                if (!match && mismatches++ < 10)
+                {
+                    std::cerr << "Mismatch at " << width << "x" << height << " rect (" << x0 << ", " << y0 << ") - ("
+                              << x1 << ", " << y1 << ")\n";
+                }
+            }
+        }
+    }
+    std::cout << rects << " rects checked, " << mismatches << " mismatched, max difference " << maxDiff << '\n';
+    return mismatches > 0 ? 1 : 0;
+}
+
+// Checks Util::blendRGBA() against the float blend it replaced for every (channel, channel, alpha) triple, allowing
+// 1 LSB, then Util::composeRow() against composeRowScalar() on random rows of every tail length, which must match
+static int runBlendCheck(const HeadlessOptions& options)
 {
-    // Check to make sure all particle types have a ParticleProperties
-    bool missingParticleProperties = false;
-    for (int i = 0; i < static_cast<int>(ParticleType::COUNT); ++i)
+    auto floatBlend = [](uint32_t a, uint32_t b) {
+        const float alpha = (b & 0xFF) / 255.f;
+        uint32_t color = 0xFF;
+        for (int shift = 8; shift < 32; shift += 8)
+        {
+            const uint32_t channel = static_cast<uint8_t>(((b >> shift) & 0xFF) * alpha + ((a >> shift) & 0xFF) * (1.f - alpha));
+            color |= channel << shift;
+        }
+        return color;
+    };
+
+    int maxBlendDiff = 0;
+    for (uint32_t alpha = 0; alpha < 256; ++alpha)
     {
-        if (!kParticleProperties.contains(static_cast<ParticleType>(i)))
+        for (uint32_t x = 0; x < 256; ++x)
         {
-            std::cerr << "[INIT] ParticleType '" << kParticleTypeNames[i] << "' does not have a ParticleProperties entry in kParticleProperties.\n";
-            missingParticleProperties = true;
+            for (uint32_t y = 0; y < 256; ++y)
+            {
+                // Each channel gets a different pair, so a lane mixup can't go unnoticed
+                const uint32_t a = (x << 24) | (y << 16) | ((x ^ 0x5A) << 8) | 0xFF;
+                const uint32_t b = (y << 24) | (x << 16) | ((y ^ 0xA5) << 8) | alpha;
+                const uint32_t blended = Util::blendRGBA(a, b);
+                const uint32_t reference = floatBlend(a, b);
+                for (int shift = 0; shift < 32; shift += 8)
+                {
+                    const int diff = std::abs(static_cast<int>((blended >> shift) & 0xFF) - static_cast<int>((reference >> shift) & 0xFF));
+                    maxBlendDiff = std::max(maxBlendDiff, diff);
+                }
+            }
         }
+    }
+    std::cout << "blendRGBA: max difference from the float blend " << maxBlendDiff << " LSB\n";
 
+    Rng rng(options.seed);
+    constexpr int kMaxCount { 67 };
+    std::vector<uint32_t> layers[4];
+    for (std::vector<uint32_t>& layer : layers) layer.resize(kMaxCount);
+    uint32_t composed[kMaxCount];
+    uint32_t reference[kMaxCount];
+    int rows = 0;
+    int mismatches = 0;
+    for (int pass = 0; pass < options.repeat * 256; ++pass)
+    {
+        // Random colours; the layers step through every alpha at every lane position across the passes
+        for (int i = 0; i < kMaxCount; ++i)
+        {
+            layers[0][i] = rng.next();
+            for (int layer = 1; layer < 4; ++layer)
+            {
+                layers[layer][i] = (rng.next() & 0xFFFFFF00) | ((pass + i * layer) & 0xFF);
+            }
+        }
+        for (int count = 0; count <= kMaxCount; ++count)
+        {
+            const uint32_t* thermal = pass & 1 ? layers[2].data() : nullptr;
+            const uint32_t* highlight = pass & 2 ? layers[3].data() : nullptr;
+            Util::composeRow(composed, layers[0].data(), layers[1].data(), thermal, highlight, count);
+            Util::composeRowScalar(reference, layers[0].data(), layers[1].data(), thermal, highlight, count);
+            ++rows;
+            if (std::memcmp(composed, reference, count * sizeof(uint32_t)) != 0 && mismatches++ < 10)
+            {
+                std::cerr << "composeRow mismatch at count " << count << (thermal ? ", thermal" : "")
+                          << (highlight ? ", highlight" : "") << '\n';
+            }
+        }
     }
-    if (missingParticleProperties) return -1;
+    std::cout << "composeRow: " << rows << " rows checked, " << mismatches << " mismatched\n";
+    return maxBlendDiff > 1 || mismatches > 0 ? 1 : 0;
+}
+
+// Runs options.steps updates of the mode's scene with threads workers and returns the total wall time in ms, adding
+// each pass's time to passTotals. The same seed gives the same run, whatever the thread count
+static double timeUpdates(const HeadlessOptions& options, int threads, UpdateTimings& passTotals)
+{
+    ParticleGrid canvas(options.width, options.height, nullptr, options.seed);
+    if (options.mode == HeadlessMode::BenchHeat) fillHeatScene(canvas);
+    else fillDemoScene(canvas);
+    canvas.setThreadCount(threads);
+
+    using Clock = std::chrono::steady_clock;
+    double totalMs = 0.;
+    for (int step = 0; step < options.steps; ++step)
+    {
+        const Clock::time_point start = Clock::now();
+        canvas.update();
+        totalMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        const UpdateTimings& timings = canvas.lastUpdateTimings();
+        passTotals.movementMs += timings.movementMs;
+        passTotals.heatMs += timings.heatMs;
+        passTotals.phaseMs += timings.phaseMs;
+    }
+    return totalMs;
+}
+
+static int runUpdateBenchmark(const HeadlessOptions& options)
+{
+    const int steps = std::max(options.steps, 1);
+    const double cells = static_cast<double>(options.width) * options.height;
+    std::cout << options.width << "x" << options.height << " update, " << options.threads << " threads\n";
+    for (int i = 0; i < options.repeat; ++i)
+    {
+        UpdateTimings passTotals;
+        const double ms = timeUpdates(options, options.threads, passTotals) / steps;
+        std::cout << "Run " << i + 1 << ": " << ms << " ms/step, " << cells / (ms * 1000.) << " Mcells/s\n";
+    }
+    return 0;
+}
+
+// Times the same run with 1 to options.threads workers, keeping the best of options.repeat runs for each count
+static int runThreadScaling(const HeadlessOptions& options)
+{
+    const int steps = std::max(options.steps, 1);
+    const int maxThreads = std::clamp(options.threads, 1, ThreadPool::maxThreadCount());
+    std::cout << options.width << "x" << options.height << (options.mode == HeadlessMode::BenchHeat ? " heat" : "")
+              << " update, " << steps << " steps, " << ThreadPool::maxThreadCount() << " hardware threads\n";
+    double singleMs = 0.;
+    for (int threads = 1; threads <= maxThreads; ++threads)
+    {
+        double bestMs = 0.;
+        UpdateTimings bestPasses;
+        for (int i = 0; i < options.repeat; ++i)
+        {
+            UpdateTimings passTotals;
+            const double ms = timeUpdates(options, threads, passTotals) / steps;
+            if (i == 0 || ms < bestMs)
+            {
+                bestMs = ms;
+                bestPasses = passTotals;
+            }
+        }
+        if (threads == 1) singleMs = bestMs;
+        std::cout << threads << " threads: " << bestMs << " ms/step, " << singleMs / bestMs << "x (move "
+                  << bestPasses.movementMs / steps << ", heat " << bestPasses.heatMs / steps << ", phase "
+                  << bestPasses.phaseMs / steps << ")\n";
+    }
+    return 0;
+}
+
+// Times building the layer pixels in draw() on the built-in scene, with the temperature overlay on so every layer is
+// drawn: first options.steps full redraws, then the redraws after each of options.steps updates (not timed)
+static int runDrawBenchmark(const HeadlessOptions& options)
+{
+    ParticleGrid canvas(options.width, options.height, nullptr, options.seed);
+    fillDemoScene(canvas);
+    canvas.setThreadCount(options.threads);
+    canvas.toggleShowTemp();
+
+    using Clock = std::chrono::steady_clock;
+    using Ms = std::chrono::duration<double, std::milli>;
+    const int steps = std::max(options.steps, 1);
+    const double cells = static_cast<double>(options.width) * options.height;
+
+    double fullMs = 0.;
+    for (int i = 0; i < steps; ++i)
+    {
+        canvas.markAllForRedraw();
+        const Clock::time_point start = Clock::now();
+        canvas.draw();
+        fullMs += Ms(Clock::now() - start).count();
+    }
+
+    double stepMs = 0.;
+    double redrawnCells = 0.;
+    for (int i = 0; i < steps; ++i)
+    {
+        canvas.update();
+        const Clock::time_point start = Clock::now();
+        canvas.draw();
+        stepMs += Ms(Clock::now() - start).count();
+        redrawnCells += canvas.lastRedrawnCells();
+    }
+
+    std::cout << options.width << "x" << options.height << " draw, " << steps << " frames\n"
+              << "Full redraw: " << fullMs / steps << " ms/frame, " << cells * steps / (fullMs * 1000.) << " Mcells/s\n"
+              << "After update: " << stepMs / steps << " ms/frame, " << redrawnCells / steps << " cells redrawn/frame\n";
+    return 0;
+}
+
+// Ice held at its melting point next to a 1 degree cell, with no stored delta. The phase pass pins it at the melting
+// point with a zero delta, so type, temperature and delta come out unchanged and, as setParticleState() does, the
+// whole write is dropped: the latent heat it would absorb must not be kept
+static int runPhaseCheck(const HeadlessOptions& options)
+{
+    ParticleGrid canvas(8, 8, nullptr, options.seed);
+    canvas.ambientTemperature = 0.f;
+    canvas.fillRect({ .minX = 0, .minY = 0, .maxX = 7, .maxY = 7 }, defaultParticleState(ParticleType::Stone, 0.f));
+
+    ParticleState ice = defaultParticleState(ParticleType::Water, 0.f);
+    ice.phase = ParticlePhase::Solid;
+    const int iceCell = canvas.cellIndex(3, 3);
+    canvas.setParticleState(iceCell, ice);
+    canvas.setParticleState(canvas.cellIndex(4, 3), defaultParticleState(ParticleType::Stone, 1.f));
+
+    canvas.update();
+    const ParticleState state = canvas.particleState(iceCell);
+    const bool ok = state.type == ParticleType::Water && state.phase == ParticlePhase::Solid &&
+                    state.temperature == 0.f && state.temperatureDelta == 0.f && state.latentHeatAbsorbed == 0.f;
+    std::cout << "Ice at melting point after one step: " << kParticlePhaseNames[static_cast<int>(state.phase)]
+              << ", temperature " << state.temperature << ", delta " << state.temperatureDelta << ", latent heat "
+              << state.latentHeatAbsorbed << (ok ? ", unchanged\n" : ", expected the write to be dropped\n");
+    return ok ? 0 : 1;
+}
+
+static int runHeadless(int argc, char** argv)
+{
+    HeadlessOptions options;
+    if (!parseHeadlessOptions(argc, argv, options)) return 1;
+    if (options.mode == HeadlessMode::BenchFill) return runFillBenchmark(options);
+    if (options.mode == HeadlessMode::BenchUpdate) return runUpdateBenchmark(options);
+    if (options.mode == HeadlessMode::BenchThreads || options.mode == HeadlessMode::BenchHeat) return runThreadScaling(options);
+    if (options.mode == HeadlessMode::BenchDraw) return runDrawBenchmark(options);
+    if (options.mode == HeadlessMode::CheckHeat) return runHeatCheck(options);
+    if (options.mode == HeadlessMode::CheckBlend) return runBlendCheck(options);
+    if (options.mode == HeadlessMode::CheckPhase) return runPhaseCheck(options);
+
+    std::error_code error;
+    std::filesystem::create_directories(options.out, error);
+    if (error)
+    {
+        std::cerr << "Failed to create " << options.out << ": " << error.message() << '\n';
+        return 1;
+    }
+
+    using Clock = std::chrono::steady_clock;
+    using Ms = std::chrono::duration<double, std::milli>;
+    std::unique_ptr<ParticleGrid> canvas;
+    if (!options.load.empty())
+    {
+        const Clock::time_point loadStart = Clock::now();
+        std::string loadError;
+        canvas = Snapshot::load(options.load, nullptr, loadError);
+        if (!canvas)
+        {
+            std::cerr << loadError << '\n';
+            return 1;
+        }
+        std::cout << "Loaded " << canvas->width << "x" << canvas->height << " world from " << options.load << " in "
+                  << Ms(Clock::now() - loadStart).count() << " ms\n";
+    }
+    else
+    {
+        canvas = std::make_unique<ParticleGrid>(options.width, options.height, nullptr, options.seed);
+        fillDemoScene(*canvas);
+    }
+    canvas->setThreadCount(options.threads);
+
+    double simMs = 0.;
+    double drawMs = 0.;
+    int submitted = 0;
+    FrameWriter writer(options.out, options.format, canvas->width, canvas->height, options.queue);
+    for (int step = 0; step < options.steps; ++step)
+    {
+        const Clock::time_point stepStart = Clock::now();
+        canvas->update();
+        simMs += Ms(Clock::now() - stepStart).count();
+
+        if ((step + 1) % options.every != 0) continue;
+
+        // Composing stays on this thread; encoding and writing happen on the writer's
+        const Clock::time_point drawStart = Clock::now();
+        canvas->draw();
+        std::vector<uint32_t> frame = writer.acquireBuffer();
+        canvas->composeFrame(frame.data());
+        writer.submit(std::move(frame), submitted++);
+        drawMs += Ms(Clock::now() - drawStart).count();
+    }
+
+    writer.flush();
+    std::cout << options.steps << " steps, " << simMs / std::max(options.steps, 1) << " ms/step, "
+              << drawMs / std::max(submitted, 1) << " ms/frame\n"
+              << writer.writtenCount() << " frames written to " << options.out << ", "
+              << writer.droppedCount() << " dropped, " << writer.failedCount() << " failed\n";
+
+    if (!options.save.empty())
+    {
+        const Clock::time_point saveStart = Clock::now();
+        std::string saveError;
+        if (!Snapshot::save(*canvas, options.save, true, saveError))
+        {
+            std::cerr << saveError << '\n';
+            return 1;
+        }
+        std::cout << "Saved world to " << options.save << " in " << Ms(Clock::now() - saveStart).count() << " ms\n";
+    }
+    return writer.failedCount() > 0 ? 1 : 0;
+}
+#endif
+
+int main(int argc, char** argv)
+{
+#ifndef EMSCRIPTEN
+    for (int i = 1; i < argc; ++i)
+    {
+        HeadlessMode mode;
+        if (parseHeadlessMode(argv[i], mode)) return runHeadless(argc, argv);
+    }
+#endif
 
     SDL_Init(SDL_INIT_VIDEO);
-    std::srand(std::time(0));
     
     window = SDL_CreateWindow("SandToy", kScreenWidth, kScreenHeight, SDL_WINDOW_OPENGL);
     renderer = SDL_CreateRenderer(window, nullptr);
     SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderVSync(renderer, 1);
 
     // ImGui init //
     ImGui::CreateContext();
@@ -323,10 +1050,20 @@ int main(int argc, char** argv)
     ImGui_ImplSDL3_InitForSDLRenderer(window, renderer);
     ImGui_ImplSDLRenderer3_Init(renderer);
 
-    grid = new ParticleGrid(kGridWidth, kGridHeight, renderer);
+    grid = new ParticleGrid(kGridWidth, kGridHeight, renderer, static_cast<uint64_t>(std::time(0)));
     brush = new Brush(5.f, ParticleType::Sand);
     brush->setCanvas(grid);
+    // sandtoy --load FILE opens a saved world instead of an empty one
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--load") != 0) continue;
+        std::string error;
+        std::strncpy(guiSnapshotPath, argv[i + 1], sizeof(guiSnapshotPath) - 1);
+        if (!loadWorld(argv[i + 1], error)) std::cerr << error << '\n';
+        break;
+    }
 
+    lastFrameStart = SDL_GetPerformanceCounter();
 #ifdef EMSCRIPTEN
     emscripten_set_main_loop(mainloop, 0, 1);
 #else
@@ -0,0 +1,39 @@
+#include "palette.h"
+
+
+Palette::Palette()
+{
+    // Magenta flags types without a palette
+    for (auto& variations : m_base)
+    {
+        variations.fill(0xFF00FFFF);
+    }
+    auto setBase = [this](ParticleType type, std::array<uint32_t, kVariationCount> colors) {
+        m_base[static_cast<size_t>(type)] = colors;
+    };
+    setBase(ParticleType::Air,      { 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000 });
+    setBase(ParticleType::Stone,    { 0x4A4A4AFF, 0x505050FF, 0x464646FF, 0x4C4C4CFF, 0x444444FF });
+    //setBase(ParticleType::Gravel, { 0x3A3128FF, 0x615441FF, 0x89785CFF, 0x333333FF, 0x272727FF });
+    setBase(ParticleType::Gravel,   { 0x6A6A6AFF, 0x707070FF, 0x666666FF, 0x5E5E5EFF, 0x747474FF });
+    setBase(ParticleType::Dirt,     { 0x5A3A1EFF, 0x684425FF, 0x4E3018FF, 0x6F482BFF, 0x59391FFF });
+    //setBase(ParticleType::Sand,   { 0xF6D7B0FF, 0xF2D2A9FF, 0xECCCA2FF, 0xE7C496FF, 0xE1BF92FF });
+    setBase(ParticleType::Sand,     { 0xE2C290FF, 0xD6B77EFF, 0xF0D8A8FF, 0xCCAA72FF, 0xB8935EFF });
+    setBase(ParticleType::Rainbow,  { 0xEF476FFF, 0xFFA600FF, 0x06D6A0FF, 0x118AB2FF, 0x9B5DE5FF });
+    setBase(ParticleType::Pink,     { 0xFFC0CBFF, 0xFFB6C1FF, 0xFF69B4FF, 0xFF1493FF, 0xDB7093FF });
+    setBase(ParticleType::Blue,     { 0x3A75C4FF, 0x4682B4FF, 0x5B9BD5FF, 0x4F83CCFF, 0x357EC7FF });
+    setBase(ParticleType::Water,    { 0x4DA6FF66, 0x4CA4F966, 0x4BA2F566, 0x4CA3FB66, 0x4EA7FD66 });
+    setBase(ParticleType::Crucible, { 0x2A2A2A66, 0x2C2C2C66, 0x2E2E2E66, 0x31313166, 0x35353566 });
+
+    // Sample each gradient at the temperature every step stands for
+    m_temperature.resize(static_cast<size_t>(kModeCount) * kTemperatureSteps);
+    for (int mode = 0; mode < kModeCount; ++mode)
+    {
+        const Util::TemperatureColorMode colorMode = mode == kModeCount - 1 ? Util::TemperatureColorMode::Radiation
+                                                                            : static_cast<Util::TemperatureColorMode>(mode);
+        for (int step = 0; step < kTemperatureSteps; ++step)
+        {
+            const float tempC = Util::kAbsZero + step / kStepScale;
+            m_temperature[mode * kTemperatureSteps + step] = Util::temperatureToColor(tempC, colorMode);
+        }
+    }
+}
@@ -5,459 +5,1108 @@
 #include <cassert>
 #include <iostream>
 #include <algorithm>
-#include <random>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <initializer_list>
+#include <utility>
 
 
-constexpr CellState kDefaultCellState { .temperature = 0, .temperatureDelta = 0};
+// Chunks whose cells all change by less than this per step drop out of the heat pass
+constexpr float kThermalEpsilon { 1e-3f };
+// draw() sweeps a whole layer in order once at least 1 / kFullRedrawRatio of its cells need a redraw
+constexpr size_t kFullRedrawRatio { 4 };
+constexpr uint32_t kBrushHighlight { 0xFFFFFF22 };
 
-Cell::Cell(ParticleGrid* particleGrid, int _x, int _y, ParticleState particleState) 
-    : x(_x), y(_y)
-    , m_particleState(particleState)
-    , m_needsRedraw(false)
-    , m_isBrushSelected(false)
-    , m_cellState(kDefaultCellState)
+ParticleGrid::ParticleGrid(const int w, const int h, SDL_Renderer* renderer, uint64_t seed)
+    : width(w)
+    , height(h)
+    , m_particleLayer(renderer, w, h, false)
+    , m_glowLayer(renderer, w, h, true)
+    , m_thermalLayer(renderer, w, h, true)
+    , m_brushLayer(renderer, w, h, true)
+    , m_chunks(w, h)
+    , m_lastAmbientTemperature(ambientTemperature)
+    , m_threadPool(ThreadPool::maxThreadCount())
+    , m_seed(seed)
+    , m_camera(w, h, static_cast<float>(w), static_cast<float>(h))
 {
-    if (particleGrid == nullptr)
+    assert(w > 0 && "w must be greater than 0");
+    assert(h > 0 && "h must be greater than 0");
+
+    const size_t nCells = static_cast<size_t>(width) * height;
+    const ParticleState air = defaultParticleState(ParticleType::Air, ambientTemperature);
+    m_type.assign(nCells, air.type);
+    m_phase.assign(nCells, air.phase);
+    m_temperature.assign(nCells, air.temperature);
+    m_temperatureDelta.assign(nCells, air.temperatureDelta);
+    m_latentHeat.assign(nCells, air.latentHeatAbsorbed);
+    m_flags.assign(nCells, 0);
+    m_colorVariation.resize(nCells);
+    m_heat.resize(width, height);
+    m_bandChanges.resize(m_chunks.height);
+
+    const int maxWorkers = ThreadPool::maxThreadCount();
+    m_coords.resize(maxWorkers);
+    m_phaseScratch.resize(maxWorkers);
+    for (PhaseScratch& scratch : m_phaseScratch)
     {
-        throw std::runtime_error("particleGrid must not be null");
+        scratch.rowFlags.resize(ChunkMap::kChunkSize);
+        scratch.rowStoredDeltas.resize(ChunkMap::kChunkSize);
     }
-    m_particleGrid = particleGrid;
-    colorVariation = std::rand() % 5;
+    m_colorRedrawBits.assign((nCells + 63) / 64, 0);
+    m_heatRedrawBits.assign((nCells + 63) / 64, 0);
+    m_snapshot.type.resize(nCells);
+    m_snapshot.temperature.resize(nCells);
+    m_snapshot.colorRedrawBits.assign(m_colorRedrawBits.size(), 0);
+    m_snapshot.heatRedrawBits.assign(m_heatRedrawBits.size(), 0);
+    m_snapshot.publishTime = std::chrono::steady_clock::now();
+
+    Rng rng(m_seed);
+    for (int i = 0; i < static_cast<int>(nCells); ++i)
+    {
+        m_colorVariation[i] = rng.bounded(Palette::kVariationCount);
+    }
+    markAllForRedraw();
+    m_chunks.wakeAll();
+
+    m_renderer = renderer;
+    int rW, rH;
+    if (m_renderer && SDL_GetCurrentRenderOutputSize(m_renderer, &rW, &rH))
+    {
+        m_camera.setViewport(static_cast<float>(rW), static_cast<float>(rH));
+        m_camera.reset();
+    }
+}
+ParticleGrid::~ParticleGrid()
+{
+    setRenderThreadEnabled(false);
+}
+
+ParticleState ParticleGrid::particleState(int idx) const
+{
+    return { 
+        .type = m_type[idx], 
+        .phase = m_phase[idx], 
+        .temperature = m_temperature[idx], 
+        .temperatureDelta = m_temperatureDelta[idx], 
+        .latentHeatAbsorbed = m_latentHeat[idx] 
+    };
 }
-void Cell::setParticleState(ParticleState state)
+void ParticleGrid::setParticleState(int idx, ParticleState state)
 {
-    if (state == m_particleState)
+    if (state.type == m_type[idx] && state.temperature == m_temperature[idx] && state.temperatureDelta == m_temperatureDelta[idx])
     {
         return;
     }
-    if (state.type != m_particleState.type || state.temperature != m_particleState.temperature)
+    if (state.type != m_type[idx]) markColorRedraw(idx);
+    if (state.temperature != m_temperature[idx]) markHeatRedraw(idx);
+    m_type[idx] = state.type;
+    m_phase[idx] = state.phase;
+    m_temperature[idx] = state.temperature;
+    m_temperatureDelta[idx] = state.temperatureDelta;
+    m_latentHeat[idx] = state.latentHeatAbsorbed;
+    wakeCell(idx);
+}
+void CellRegion::resize(int w, int h)
+{
+    width = w;
+    height = h;
+    const size_t nCells = static_cast<size_t>(w) * h;
+    type.resize(nCells);
+    phase.resize(nCells);
+    temperature.resize(nCells);
+    temperatureDelta.resize(nCells);
+    latentHeat.resize(nCells);
+}
+
+// Clips an inclusive rect to the grid; empty if it misses it
+static DirtyRect clipRect(const DirtyRect& rect, int width, int height)
+{
+    DirtyRect clipped;
+    clipped.include(std::max(rect.minX, 0), std::max(rect.minY, 0), std::min(rect.maxX, width - 1), std::min(rect.maxY, height - 1));
+    if (clipped.minY > clipped.maxY) clipped.reset();
+    return clipped;
+}
+
+void ParticleGrid::fillSpan(int y, int x0, int x1, ParticleState state)
+{
+    x0 = std::max(x0, 0);
+    x1 = std::min(x1, width - 1);
+    if (y < 0 || y >= height || x0 > x1) return;
+
+    DirtyRect changed;
+    fillRun(y * width + x0, y * width + x1, state, changed);
+    wakeChanged(changed);
+}
+void ParticleGrid::fillSpans(const std::vector<CellSpan>& spans, ParticleState state)
+{
+    // Changes are gathered per chunk row, so a long diagonal stroke doesn't wake its whole bounding box
+    for (const CellSpan& span : spans)
     {
-        markForRedraw();
+        const int x0 = std::max(span.x0, 0);
+        const int x1 = std::min(span.x1, width - 1);
+        if (span.y < 0 || span.y >= height || x0 > x1) continue;
+
+        fillRun(span.y * width + x0, span.y * width + x1, state, m_bandChanges[span.y / ChunkMap::kChunkSize]);
     }
-    m_particleState = state;
+    wakeChangedBands();
 }
-ParticleState Cell::particleState() const
+void ParticleGrid::fillRect(const DirtyRect& rect, ParticleState state)
 {
-    return m_particleState;
+    const DirtyRect clipped = clipRect(rect, width, height);
+    if (clipped.empty()) return;
+
+    DirtyRect changed;
+    for (int y = clipped.minY; y <= clipped.maxY; ++y)
+    {
+        fillRun(y * width + clipped.minX, y * width + clipped.maxX, state, changed);
+    }
+    wakeChanged(changed);
 }
-void Cell::setCellState(CellState state)
+void ParticleGrid::fillMask(int x, int y, int maskWidth, int maskHeight, const uint8_t* mask, ParticleState state)
 {
-    if (state == m_cellState)
+    const DirtyRect clipped = clipRect({ .minX = x, .minY = y, .maxX = x + maskWidth - 1, .maxY = y + maskHeight - 1 },
+        width, height);
+    if (clipped.empty()) return;
+
+    DirtyRect changed;
+    for (int cy = clipped.minY; cy <= clipped.maxY; ++cy)
     {
-        return;
+        const uint8_t* row = mask + static_cast<size_t>(cy - y) * maskWidth;
+        // Fill each run of set mask bytes in one go
+        for (int cx = clipped.minX; cx <= clipped.maxX; ++cx)
+        {
+            if (!row[cx - x]) continue;
+            const int runStart = cx;
+            while (cx < clipped.maxX && row[cx + 1 - x]) ++cx;
+            fillRun(cy * width + runStart, cy * width + cx, state, changed);
+        }
     }
-    if (state.temperature != m_cellState.temperature)
+    wakeChanged(changed);
+}
+void ParticleGrid::addTemperatureDelta(const DirtyRect& rect, float delta)
+{
+    const DirtyRect clipped = clipRect(rect, width, height);
+    if (clipped.empty() || delta == 0.f) return;
+
+    for (int y = clipped.minY; y <= clipped.maxY; ++y)
     {
-        markForRedraw();
+        addTemperatureDeltaRun(y * width + clipped.minX, y * width + clipped.maxX, delta);
     }
-    m_cellState = state;
+    DirtyRect changed = clipped;
+    wakeChanged(changed);
 }
-CellState Cell::cellState() const
+void ParticleGrid::addTemperatureDelta(const std::vector<CellSpan>& spans, float delta)
 {
-    return m_cellState;
+    if (delta == 0.f) return;
+
+    for (const CellSpan& span : spans)
+    {
+        const int x0 = std::max(span.x0, 0);
+        const int x1 = std::min(span.x1, width - 1);
+        if (span.y < 0 || span.y >= height || x0 > x1) continue;
+
+        addTemperatureDeltaRun(span.y * width + x0, span.y * width + x1, delta);
+        m_bandChanges[span.y / ChunkMap::kChunkSize].include(x0, span.y, x1, span.y);
+    }
+    wakeChangedBands();
 }
+void ParticleGrid::copyRegion(const DirtyRect& rect, CellRegion& out) const
+{
+    const DirtyRect clipped = clipRect(rect, width, height);
+    if (clipped.empty())
+    {
+        out.resize(0, 0);
+        return;
+    }
 
-void Cell::setBrushSelected(bool selected)
+    const int w = clipped.maxX - clipped.minX + 1;
+    out.resize(w, clipped.maxY - clipped.minY + 1);
+    for (int y = clipped.minY; y <= clipped.maxY; ++y)
+    {
+        const int src = y * width + clipped.minX;
+        const int dst = (y - clipped.minY) * w;
+        std::copy_n(&m_type[src], w, &out.type[dst]);
+        std::copy_n(&m_phase[src], w, &out.phase[dst]);
+        std::copy_n(&m_temperature[src], w, &out.temperature[dst]);
+        std::copy_n(&m_temperatureDelta[src], w, &out.temperatureDelta[dst]);
+        std::copy_n(&m_latentHeat[src], w, &out.latentHeat[dst]);
+    }
+}
+void ParticleGrid::pasteRegion(const CellRegion& region, int x, int y)
 {
-    if (m_isBrushSelected != selected)
+    const DirtyRect clipped = clipRect({ .minX = x, .minY = y, .maxX = x + region.width - 1, .maxY = y + region.height - 1 },
+        width, height);
+    if (clipped.empty()) return;
+
+    // Compare first so only cells that differ are marked and woken, then copy each row's planes whole
+    DirtyRect changed;
+    const int w = clipped.maxX - clipped.minX + 1;
+    for (int cy = clipped.minY; cy <= clipped.maxY; ++cy)
     {
-        m_isBrushSelected = selected;
-        markForRedraw();
+        const int dst = cy * width + clipped.minX;
+        const int src = (cy - y) * region.width + clipped.minX - x;
+        int changedMin = INT_MAX;
+        int changedMax = INT_MIN;
+        for (int i = 0; i < w; ++i)
+        {
+            const bool typeChanged = m_type[dst + i] != region.type[src + i];
+            const bool heatChanged = m_temperature[dst + i] != region.temperature[src + i];
+            if (typeChanged) markColorRedraw(dst + i);
+            if (heatChanged) markHeatRedraw(dst + i);
+            if (typeChanged || heatChanged || m_phase[dst + i] != region.phase[src + i] ||
+                m_temperatureDelta[dst + i] != region.temperatureDelta[src + i] ||
+                m_latentHeat[dst + i] != region.latentHeat[src + i])
+            {
+                changedMin = std::min(changedMin, i);
+                changedMax = i;
+            }
+        }
+        if (changedMin > changedMax) continue;
+
+        std::copy_n(&region.type[src], w, &m_type[dst]);
+        std::copy_n(&region.phase[src], w, &m_phase[dst]);
+        std::copy_n(&region.temperature[src], w, &m_temperature[dst]);
+        std::copy_n(&region.temperatureDelta[src], w, &m_temperatureDelta[dst]);
+        std::copy_n(&region.latentHeat[src], w, &m_latentHeat[dst]);
+        changed.include(clipped.minX + changedMin, cy, clipped.minX + changedMax, cy);
     }
+    wakeChanged(changed);
 }
-bool Cell::isBrushSelected() const
+void ParticleGrid::swapParticles(int a, int b)
 {
-    return m_isBrushSelected;
+    if (m_type[a] == m_type[b] && m_temperature[a] == m_temperature[b] && m_temperatureDelta[a] == m_temperatureDelta[b])
+    {
+        return;
+    }
+    if (m_type[a] != m_type[b])
+    {
+        // Swapping identical materials only moves heat around, which the heat pass already tracks
+        wakeCell(a);
+        wakeCell(b);
+        markColorRedraw(a);
+        markColorRedraw(b);
+    }
+    if (m_temperature[a] != m_temperature[b])
+    {
+        markHeatRedraw(a);
+        markHeatRedraw(b);
+    }
+    std::swap(m_type[a], m_type[b]);
+    std::swap(m_phase[a], m_phase[b]);
+    std::swap(m_temperature[a], m_temperature[b]);
+    std::swap(m_temperatureDelta[a], m_temperatureDelta[b]);
+    std::swap(m_latentHeat[a], m_latentHeat[b]);
 }
-void Cell::setBrushOutline(bool selected)
+
+void ParticleGrid::setBrushSelected(int idx, bool selected)
 {
-    if (m_isBrushOutline != selected)
+    if (isBrushSelected(idx) != selected)
     {
-        m_isBrushOutline = selected;
-        markForRedraw();
+        m_flags[idx] ^= CellFlags::BrushSelected;
+        m_brushRedrawCells.push_back(idx);
     }
 }
-bool Cell::isBrushOutline() const
+void ParticleGrid::setBrushSelectedSpan(int y, int x0, int x1, bool selected)
 {
-    return m_isBrushOutline;
+    for (int idx = y * width + x0; idx <= y * width + x1; ++idx)
+    {
+        if (isBrushSelected(idx) != selected)
+        {
+            m_flags[idx] ^= CellFlags::BrushSelected;
+            m_brushRedrawCells.push_back(idx);
+        }
+    }
 }
 
-void Cell::markForRedraw()
+// Neighbouring cells share a word across chunk edges, so workers have to set bits atomically.
+// Most cells are marked again before the next draw, and the plain load skips the locked op for those
+static void setRedrawBit(std::vector<uint64_t>& bits, int idx)
 {
-    if (!m_needsRedraw)
+    std::atomic_ref<uint64_t> word(bits[idx >> 6]);
+    const uint64_t bit = uint64_t(1) << (idx & 63);
+    if (!(word.load(std::memory_order_relaxed) & bit))
     {
-        m_particleGrid->m_redrawCells.push_back(this);
-        m_needsRedraw = true;
+        word.fetch_or(bit, std::memory_order_relaxed);
     }
 }
-
-ParticleGrid::ParticleGrid(const int w, const int h, SDL_Renderer* renderer)
-    : width(w)
-    , height(h)
+static void setAllRedrawBits(std::vector<uint64_t>& bits, int cellCount)
 {
-    assert(w > 0 && "w must be greater than 0");
-    assert(h > 0 && "h must be greater than 0");
-
-    m_particles.reserve(width * height);
-    for (int y = 0; y < height; ++y)
+    std::fill(bits.begin(), bits.end(), ~uint64_t(0));
+    if (cellCount & 63)
     {
-        for (int x = 0; x < width; ++x)
+        bits.back() = (uint64_t(1) << (cellCount & 63)) - 1;
+    }
+}
+void ParticleGrid::markColorRedraw(int idx)
+{
+    setRedrawBit(m_colorRedrawBits, idx);
+}
+void ParticleGrid::markHeatRedraw(int idx)
+{
+    setRedrawBit(m_heatRedrawBits, idx);
+}
+// Sets the bits of mask in one word of a redraw bitmap
+static void setRedrawBits(std::vector<uint64_t>& bits, int word, uint64_t mask)
+{
+    if (mask) std::atomic_ref<uint64_t>(bits[word]).fetch_or(mask, std::memory_order_relaxed);
+}
+void ParticleGrid::fillRun(int first, int last, const ParticleState& state, DirtyRect& changed)
+{
+    // Mark what changes first, a word of redraw bits at a time, then overwrite from the first to the last changed cell
+    int changedMin = INT_MAX;
+    int changedMax = INT_MIN;
+    for (int word = first >> 6; word <= last >> 6; ++word)
+    {
+        const int begin = std::max(first, word << 6);
+        const int end = std::min(last, (word << 6) + 63);
+        uint64_t colorMask = 0;
+        uint64_t heatMask = 0;
+        for (int idx = begin; idx <= end; ++idx)
         {
-            m_particles.emplace_back(this, x, y, defaultParticleState(ParticleType::Air, ambientTemperature));
-            m_coords.emplace_back(x, y);
-
-            m_particles.back().markForRedraw();
+            const uint64_t bit = uint64_t(1) << (idx & 63);
+            const bool typeChanged = m_type[idx] != state.type;
+            const bool heatChanged = m_temperature[idx] != state.temperature;
+            colorMask |= typeChanged ? bit : 0;
+            heatMask |= heatChanged ? bit : 0;
+            if (typeChanged || heatChanged || m_temperatureDelta[idx] != state.temperatureDelta)
+            {
+                changedMin = std::min(changedMin, idx);
+                changedMax = idx;
+            }
         }
+        setRedrawBits(m_colorRedrawBits, word, colorMask);
+        setRedrawBits(m_heatRedrawBits, word, heatMask);
     }
-
-    m_renderer = renderer;
-    int rW, rH;
-    SDL_GetCurrentRenderOutputSize(m_renderer, &rW, &rH);
-    m_rendererRect = { .x = 0, .y = 0, .w = static_cast<float>(rW), .h = static_cast<float>(rH) };
-
-    m_streamingTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, w, h);
-    SDL_SetTextureScaleMode(m_streamingTexture, SDL_SCALEMODE_NEAREST);
+    if (changedMin > changedMax) return;
+
+    const int changedCount = changedMax - changedMin + 1;
+    std::fill_n(&m_type[changedMin], changedCount, state.type);
+    std::fill_n(&m_phase[changedMin], changedCount, state.phase);
+    std::fill_n(&m_temperature[changedMin], changedCount, state.temperature);
+    std::fill_n(&m_temperatureDelta[changedMin], changedCount, state.temperatureDelta);
+    std::fill_n(&m_latentHeat[changedMin], changedCount, state.latentHeatAbsorbed);
+    const int y = cellY(changedMin);
+    changed.include(cellX(changedMin), y, cellX(changedMax), y);
 }
-ParticleGrid::~ParticleGrid()
+void ParticleGrid::addTemperatureDeltaRun(int first, int last, float delta)
 {
-    SDL_DestroyTexture(m_streamingTexture);
+    for (int idx = first; idx <= last; ++idx)
+    {
+        m_temperatureDelta[idx] += delta;
+    }
 }
-
-Cell* ParticleGrid::getCell(int x, int y)
+void ParticleGrid::wakeChanged(DirtyRect& changed)
+{
+    if (changed.empty()) return;
+    m_chunks.wakeRect(changed.minX - 1, changed.minY - 1, changed.maxX + 1, changed.maxY + 1);
+    changed.reset();
+}
+void ParticleGrid::wakeChangedBands()
 {
-    if (y >= height || y < 0 || x >= width || x < 0)
+    for (DirtyRect& band : m_bandChanges)
     {
-        return nullptr;
+        wakeChanged(band);
     }
+}
+void ParticleGrid::markForRedraw(int idx)
+{
+    markColorRedraw(idx);
+    markHeatRedraw(idx);
+}
+void ParticleGrid::markAllForRedraw()
+{
+    setAllRedrawBits(m_colorRedrawBits, width * height);
+    setAllRedrawBits(m_heatRedrawBits, width * height);
+}
 
-    return &m_particles[y * width + x];
+void ParticleGrid::setThreadCount(int threadCount)
+{
+    m_threadPool.setThreadCount(threadCount);
+}
+int ParticleGrid::threadCount() const
+{
+    return m_threadPool.threadCount();
+}
+void ParticleGrid::setTraversalMode(TraversalMode mode)
+{
+    m_traversalMode = mode;
+}
+TraversalMode ParticleGrid::traversalMode() const
+{
+    return m_traversalMode;
+}
+void ParticleGrid::setSeed(uint64_t seed)
+{
+    m_seed = seed;
+    m_frame = 0;
+}
+uint64_t ParticleGrid::seed() const
+{
+    return m_seed;
 }
 
-void ParticleGrid::draw()
+// Calls fn(word, mask) for each word of a one-bit-per-cell bitmap that covers cells of rect, with mask selecting
+// the bits inside it. Rects spanning whole rows are walked as one run
+template <typename WordFn>
+static void forEachRectWord(int width, const DirtyRect& rect, WordFn&& fn)
 {
-    void* pixels;
-    int pitch;
-    SDL_LockTexture(m_streamingTexture, nullptr, &pixels, &pitch);
-    if (pitch / sizeof(Uint32) != width)
+    const bool fullRows = rect.minX == 0 && rect.maxX == width - 1;
+    for (int y = rect.minY; y <= rect.maxY; ++y)
     {
-        std::cerr << "Streaming texture dimensions don't match those of the particle grid" << std::endl;
-        return;
+        const size_t first = static_cast<size_t>(y) * width + rect.minX;
+        const size_t last = static_cast<size_t>(fullRows ? rect.maxY : y) * width + rect.maxX;
+        for (size_t word = first / 64; word <= last / 64; ++word)
+        {
+            uint64_t mask = ~uint64_t(0);
+            if (word == first / 64) mask &= ~uint64_t(0) << (first % 64);
+            if (word == last / 64) mask &= ~uint64_t(0) >> (63 - last % 64);
+            fn(word, mask);
+        }
+        if (fullRows) break;
     }
-    Uint32* pixelBuffer = static_cast<Uint32*>(pixels);
+}
+
+// Calls redraw(idx) for every cell of view marked in bits, flags the cell in each layer and clears its bit; marks
+// outside view are kept. Below the full-redraw ratio this walks the set bits; above it, every cell of view is
+// redrawn in one ordered sweep. Returns the number of cells redrawn
+template <typename RedrawFn>
+static int redrawMarkedCells(std::vector<uint64_t>& bits, int width, const DirtyRect& view,
+                             std::initializer_list<RenderLayer*> layers, RedrawFn&& redraw)
+{
+    if (view.empty()) return 0;
 
-    for (Cell* cell : m_redrawCells)
+    size_t redrawCount = 0;
+    forEachRectWord(width, view, [&](size_t word, uint64_t mask) {
+        redrawCount += std::popcount(bits[word] & mask);
+    });
+    if (redrawCount == 0) return 0;
+
+    const size_t viewCells = static_cast<size_t>(view.maxX - view.minX + 1) * (view.maxY - view.minY + 1);
+    if (redrawCount * kFullRedrawRatio >= viewCells)
     {
-        Uint32 cellColor;
-        switch (cell->particleState().type)
+        for (int y = view.minY; y <= view.maxY; ++y)
         {
-        default:
-            cellColor = 0xFF00FFFF;
-            break;
-
-        case ParticleType::Air:
-            cellColor = 0x00000000;
-            break;
-        
-        case ParticleType::Stone:
+            for (int idx = y * width + view.minX; idx <= y * width + view.maxX; ++idx)
+            {
+                redraw(idx);
+            }
+        }
+        for (RenderLayer* layer : layers)
         {
-            Uint32 choices[] = { 0x4A4A4AFF, 0x505050FF, 0x464646FF, 0x4C4C4CFF, 0x444444FF };
-            cellColor = choices[cell->colorVariation];
-            break;
+            layer->markRect(view.minX, view.minY, view.maxX, view.maxY);
         }
+        forEachRectWord(width, view, [&](size_t word, uint64_t mask) {
+            bits[word] &= ~mask;
+        });
+        return static_cast<int>(viewCells);
+    }
 
-        case ParticleType::Gravel:
+    forEachRectWord(width, view, [&](size_t word, uint64_t mask) {
+        for (uint64_t set = bits[word] & mask; set; set &= set - 1)
         {
-            //Uint32 choices[] = { 0x3A3128FF, 0x615441FF, 0x89785CFF, 0x333333FF, 0x272727FF };
-            Uint32 choices[] = { 0x6A6A6AFF, 0x707070FF, 0x666666FF, 0x5E5E5EFF, 0x747474FF };
-            cellColor = choices[cell->colorVariation];
-            break;
+            const int idx = static_cast<int>(word * 64) + std::countr_zero(set);
+            redraw(idx);
+
+            const int y = idx / width;
+            const int x = idx - y * width;
+            for (RenderLayer* layer : layers)
+            {
+                layer->markCell(x, y);
+            }
         }
+        bits[word] &= ~mask;
+    });
+    return static_cast<int>(redrawCount);
+}
 
-        case ParticleType::Dirt:
+void ParticleGrid::draw()
+{
+    if (m_renderThread.joinable())
+    {
+        const auto waitStart = std::chrono::steady_clock::now();
+        waitForProducer();
+        m_renderStats.waitMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - waitStart).count();
+        uploadAndRender();
+        publishSnapshot();
+        m_publishedFrame.fetch_add(1, std::memory_order_release);
+        m_publishedFrame.notify_one();
+    }
+    else
+    {
+        publishSnapshot();
+        producePixels();
+        m_renderStats.waitMs = 0.f;
+        uploadAndRender();
+    }
+}
+void ParticleGrid::publishSnapshot()
+{
+    // Only cells marked for redraw changed since the last snapshot, so copy the 64-cell spans they sit in and move
+    // the marks over. The snapshot may still hold marks for cells off screen, so they are merged rather than swapped
+    const size_t nCells = m_type.size();
+    for (size_t word = 0; word < m_colorRedrawBits.size(); ++word)
+    {
+        const size_t first = word * 64;
+        const size_t count = std::min<size_t>(64, nCells - first);
+        if (const uint64_t bits = std::exchange(m_colorRedrawBits[word], 0))
         {
-            Uint32 choices[] = { 0x5A3A1EFF, 0x684425FF, 0x4E3018FF, 0x6F482BFF, 0x59391FFF };
-            cellColor = choices[cell->colorVariation];
-            break;
+            std::copy_n(&m_type[first], count, &m_snapshot.type[first]);
+            m_snapshot.colorRedrawBits[word] |= bits;
         }
-
-        case ParticleType::Sand:
+        if (const uint64_t bits = std::exchange(m_heatRedrawBits[word], 0))
         {
-            //Uint32 choices[] = { 0xF6D7B0FF, 0xF2D2A9FF, 0xECCCA2FF, 0xE7C496FF, 0xE1BF92FF };
-            Uint32 choices[] = { 0xE2C290FF, 0xD6B77EFF, 0xF0D8A8FF, 0xCCAA72FF, 0xB8935EFF };
-            cellColor = choices[cell->colorVariation];
-            break;
+            std::copy_n(&m_temperature[first], count, &m_snapshot.temperature[first]);
+            m_snapshot.heatRedrawBits[word] |= bits;
         }
+    }
+
+    m_snapshot.brushCells.clear();
+    for (int idx : m_brushRedrawCells)
+    {
+        m_snapshot.brushCells.emplace_back(idx, isBrushSelected(idx));
+    }
+    m_brushRedrawCells.clear();
+
+    m_snapshot.rebuildThermal = m_thermalRebuildPending;
+    m_snapshot.tempColorMode = m_tempColorMode;
+    m_thermalRebuildPending = false;
+    m_snapshot.view = m_camera.visibleCells();
+    m_snapshot.publishTime = std::chrono::steady_clock::now();
+}
+void ParticleGrid::producePixels()
+{
+    const auto start = std::chrono::steady_clock::now();
+    RenderSnapshot& snapshot = m_snapshot;
+    snapshot.redrawnCells = 0;
+
+    // Particle layer: base colours, drawn opaque
+    uint32_t* particlePixels = m_particleLayer.pixels();
+    snapshot.redrawnCells += redrawMarkedCells(snapshot.colorRedrawBits, width, snapshot.view, { &m_particleLayer }, [&](int idx) {
+        particlePixels[idx] = m_palette.base(snapshot.type[idx], m_colorVariation[idx]) | 0xFF;
+    });
+
+    // Blackbody glow and the thermal view only depend on temperature. The thermal layer is kept current while
+    // hidden so showing it just uploads what changed since
+    const uint32_t* glow = m_palette.gradient(Util::TemperatureColorMode::Radiation);
+    const uint32_t* thermal = m_palette.gradient(snapshot.tempColorMode);
+    uint32_t* glowPixels = m_glowLayer.pixels();
+    uint32_t* thermalPixels = m_thermalLayer.pixels();
+    if (snapshot.rebuildThermal)
+    {
+        // A new colour mode recolours every cell, each as it comes into view
+        setAllRedrawBits(snapshot.heatRedrawBits, width * height);
+    }
+    snapshot.redrawnCells += redrawMarkedCells(snapshot.heatRedrawBits, width, snapshot.view, { &m_glowLayer, &m_thermalLayer }, [&](int idx) {
+        const int tempStep = Palette::temperatureStep(snapshot.temperature[idx]);
+        glowPixels[idx] = glow[tempStep];
+        thermalPixels[idx] = thermal[tempStep];
+    });
+
+    uint32_t* brushPixels = m_brushLayer.pixels();
+    for (auto [idx, selected] : snapshot.brushCells)
+    {
+        brushPixels[idx] = selected ? kBrushHighlight : 0;
+        m_brushLayer.markCell(cellX(idx), cellY(idx));
+    }
+    snapshot.redrawnCells += static_cast<int>(snapshot.brushCells.size());
+
+    snapshot.produceMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+void ParticleGrid::waitForProducer() const
+{
+    const uint64_t published = m_publishedFrame.load(std::memory_order_relaxed);
+    uint64_t produced = m_producedFrame.load(std::memory_order_acquire);
+    while (produced < published)
+    {
+        m_producedFrame.wait(produced, std::memory_order_acquire);
+        produced = m_producedFrame.load(std::memory_order_acquire);
+    }
+}
+void ParticleGrid::uploadAndRender()
+{
+    using Clock = std::chrono::steady_clock;
+    using Ms = std::chrono::duration<float, std::milli>;
+    const Clock::time_point start = Clock::now();
+
+    // Only the textures in view are created and drawn; with the render thread on, cells that just scrolled in
+    // fill in next frame
+    const DirtyRect view = m_camera.visibleCells();
+    m_uploadedPixels = m_particleLayer.upload(view) + m_glowLayer.upload(view);
+    if (m_showTemperature) m_uploadedPixels += m_thermalLayer.upload(view);
+    if (m_showBrushHighlight) m_uploadedPixels += m_brushLayer.upload(view);
+
+    const Clock::time_point end = Clock::now();
+    m_redrawnCells = m_snapshot.redrawnCells;
+    m_renderStats.produceMs = m_snapshot.produceMs;
+    m_renderStats.uploadMs = Ms(end - start).count();
+    m_renderStats.latencyMs = Ms(end - m_snapshot.publishTime).count();
+
+    m_particleLayer.render(view, m_camera);
+    m_glowLayer.render(view, m_camera);
+    if (m_showTemperature) m_thermalLayer.render(view, m_camera);
+    if (m_showBrushHighlight) m_brushLayer.render(view, m_camera);
+}
+int ParticleGrid::textureCount() const
+{
+    return m_particleLayer.textureCount() + m_glowLayer.textureCount() + m_thermalLayer.textureCount() + m_brushLayer.textureCount();
+}
+void ParticleGrid::setRenderThreadEnabled(bool enabled)
+{
+    if (enabled == m_renderThread.joinable() || (enabled && !ThreadPool::threadsSupported())) return;
 
-        case ParticleType::Rainbow:
+    if (enabled)
+    {
+        m_renderThreadStop.store(false, std::memory_order_relaxed);
+        m_producedFrame.store(m_publishedFrame.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        m_renderThread = std::thread(&ParticleGrid::renderThreadLoop, this);
+        return;
+    }
+
+    // Let the producer finish the frame in flight; its pixels are uploaded by the next draw()
+    waitForProducer();
+    m_renderThreadStop.store(true, std::memory_order_relaxed);
+    m_publishedFrame.fetch_add(1, std::memory_order_release);
+    m_publishedFrame.notify_one();
+    m_renderThread.join();
+    m_producedFrame.store(m_publishedFrame.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+void ParticleGrid::renderThreadLoop()
+{
+    // Start from the last frame produced, not the last published: draw() may publish before this thread runs
+    uint64_t seen = m_producedFrame.load(std::memory_order_acquire);
+    while (true)
+    {
+        m_publishedFrame.wait(seen, std::memory_order_acquire);
+        seen = m_publishedFrame.load(std::memory_order_acquire);
+        if (m_renderThreadStop.load(std::memory_order_relaxed)) return;
+
+        producePixels();
+        m_producedFrame.store(seen, std::memory_order_release);
+        m_producedFrame.notify_one();
+    }
+}
+void ParticleGrid::composeFrame(uint32_t* out) const
+{
+    waitForProducer();
+    for (int y = 0; y < height; ++y)
+    {
+        const int rowStart = y * width;
+        Util::composeRow(out + rowStart, m_particleLayer.pixels() + rowStart, m_glowLayer.pixels() + rowStart,
+                         m_showTemperature ? m_thermalLayer.pixels() + rowStart : nullptr,
+                         m_showBrushHighlight ? m_brushLayer.pixels() + rowStart : nullptr, width);
+    }
+}
+void ParticleGrid::update()
+{
+    // Border cells exchange heat with the ambient temperature, so a change affects every chunk
+    if (ambientTemperature != m_lastAmbientTemperature)
+    {
+        m_lastAmbientTemperature = ambientTemperature;
+        m_chunks.wakeAll();
+    }
+    m_chunks.step();
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point movementStart = Clock::now();
+    
+    // Movement: 4-phase checkerboard over the awake chunks. Chunks in the same phase are a chunk apart and
+    // particles only reach their direct neighbours, so the workers never touch the same cells
+    // Moves only reach one cell past a dirty rect, and the flag is only read inside one, so clearing the rects is enough
+    for (int c = 0; c < m_chunks.count(); ++c)
+    {
+        const DirtyRect& rect = m_chunks.chunk(c).dirty;
+        for (int y = rect.minY; y <= rect.maxY; ++y)
         {
-            Uint32 choices[] = { 0xEF476FFF, 0xFFA600FF, 0x06D6A0FF, 0x118AB2FF, 0x9B5DE5FF };
-            cellColor = choices[cell->colorVariation];
-            break;
+            for (int x = rect.minX; x <= rect.maxX; ++x)
+            {
+                m_flags[y * width + x] &= ~CellFlags::Moved;
+            }
         }
+    }
 
-        case ParticleType::Pink:
+    Rng frameRng(Rng::streamSeed(m_seed, m_frame));
+    int phases[] = { 0, 1, 2, 3 };
+    std::shuffle(std::begin(phases), std::end(phases), frameRng);
+    for (int phase : phases)
+    {
+        m_phaseChunks.clear();
+        for (int cy = phase / 2; cy < m_chunks.height; cy += 2)
         {
-            Uint32 choices[] = { 0xFFC0CBFF, 0xFFB6C1FF, 0xFF69B4FF, 0xFF1493FF, 0xDB7093FF };
-            cellColor = choices[cell->colorVariation];
-            break;
+            for (int cx = phase % 2; cx < m_chunks.width; cx += 2)
+            {
+                const int c = cy * m_chunks.width + cx;
+                if (!m_chunks.chunk(c).dirty.empty()) m_phaseChunks.push_back(c);
+            }
         }
 
-        case ParticleType::Blue:
+        m_threadPool.parallelFor(static_cast<int>(m_phaseChunks.size()), [this](int task, int worker) {
+            updateChunk(m_phaseChunks[task], worker);
+        });
+    }
+    
+    const Clock::time_point heatStart = Clock::now();
+
+    // Heat runs in horizontal bands of one chunk row. The delta plane doubles as the back buffer: phase 1 only
+    // reads temperatures, and phase 2 only starts once every band has its deltas, so band edges see the same
+    // temperatures whatever the thread count or task order
+    m_thermalBands.clear();
+    for (int cy = 0; cy < m_chunks.height; ++cy)
+    {
+        for (int cx = 0; cx < m_chunks.width; ++cx)
         {
-            Uint32 choices[] = { 0x3A75C4FF, 0x4682B4FF, 0x5B9BD5FF, 0x4F83CCFF, 0x357EC7FF };
-            cellColor = choices[cell->colorVariation];
-            break;
+            if (m_chunks.chunk(cy * m_chunks.width + cx).thermalAwake)
+            {
+                m_thermalBands.push_back(cy);
+                break;
+            }
         }
+    }
+    m_heat.setAmbient(ambientTemperature);
 
-        case ParticleType::Water:
+    // Phase 1: accumulate deltas
+    m_threadPool.parallelFor(static_cast<int>(m_thermalBands.size()), [this](int task, int) {
+        const int rowStart = m_thermalBands[task] * m_chunks.width;
+        for (int c = rowStart; c < rowStart + m_chunks.width; ++c)
         {
-            Uint32 choices[] = { 0x4DA6FF66, 0x4CA4F966, 0x4BA2F566, 0x4CA3FB66, 0x4EA7FD66 };
-            cellColor = choices[cell->colorVariation];
-            break;
+            if (m_chunks.chunk(c).thermalAwake) updateHeat(c);
         }
+    });
+    const Clock::time_point phaseStart = Clock::now();
 
-        case ParticleType::Crucible:
+    // Phase 2: Apply accumulated deltas, finalize temps and reset deltas
+    m_threadPool.parallelFor(static_cast<int>(m_thermalBands.size()), [this](int task, int worker) {
+        const int rowStart = m_thermalBands[task] * m_chunks.width;
+        for (int c = rowStart; c < rowStart + m_chunks.width; ++c)
         {
-            Uint32 choices[] = { 0x2A2A2A66, 0x2C2C2C66, 0x2E2E2E66, 0x31313166, 0x35353566 };
-            cellColor = choices[cell->colorVariation];
-            break;
-        }
+            if (m_chunks.chunk(c).thermalAwake) updatePhases(c, worker);
         }
+    });
+    const Clock::time_point end = Clock::now();
 
-        // Blackbody radiation
-        cellColor = Util::blendRGBA(cellColor, Util::temperatureToColor(cell->particleState().temperature, Util::TemperatureColorMode::Radiation));
+    using Ms = std::chrono::duration<float, std::milli>;
+    m_lastUpdateTimings.movementMs = Ms(heatStart - movementStart).count();
+    m_lastUpdateTimings.heatMs = Ms(phaseStart - heatStart).count();
+    m_lastUpdateTimings.phaseMs = Ms(end - phaseStart).count();
 
-        if (m_showTemperature) 
-        { 
-            cellColor = Util::blendRGBA(cellColor, Util::temperatureToColor(cell->particleState().temperature, m_tempColorMode));
-        }
+    ++m_frame;
+}
+void ParticleGrid::updateChunk(int chunk, int worker)
+{
+    const DirtyRect& rect = m_chunks.chunk(chunk).dirty;
+    // One stream per chunk and frame, so the result doesn't depend on which worker runs the chunk
+    Rng rng(Rng::streamSeed(m_seed, m_frame, chunk + 1));
 
-        // Add brush overlay
-        if (m_showBrushHighlight && cell->isBrushSelected())
+    switch (m_traversalMode)
+    {
+    case TraversalMode::Shuffle:
+        traverseShuffle(rect, rng, worker);
+        break;
+
+    case TraversalMode::Serpentine:
+        traverseSerpentine(rect, rng);
+        break;
+
+    default:
+    case TraversalMode::RandomRows:
+        traverseRandomRows(rect, rng);
+        break;
+
+    }
+}
+void ParticleGrid::traverseShuffle(const DirtyRect& rect, Rng& rng, int worker)
+{
+    // Full random permutation: isotropic, but a scattered walk over the planes
+    std::vector<int>& coords = m_coords[worker];
+    coords.clear();
+    for (int y = rect.minY; y <= rect.maxY; ++y)
+    {
+        for (int x = rect.minX; x <= rect.maxX; ++x)
         {
-            cellColor = Util::blendRGBA(cellColor, 0xFFFFFF22);
+            coords.push_back(y * width + x);
         }
-
-        pixelBuffer[cell->y * (pitch / sizeof(Uint32)) + cell->x] = cellColor;
-        cell->m_needsRedraw = false;
     }
-    m_redrawCells.clear();
-    
-    SDL_UnlockTexture(m_streamingTexture);
-    SDL_RenderTexture(m_renderer, m_streamingTexture, nullptr, &m_rendererRect);
+    std::shuffle(coords.begin(), coords.end(), rng);
+    for (int idx : coords)
+    {
+        updateCell(cellX(idx), cellY(idx), rng);
+    }
 }
-void ParticleGrid::update()
+void ParticleGrid::traverseSerpentine(const DirtyRect& rect, Rng& rng)
 {
-    static std::random_device rd;
-    static std::mt19937 g(rd());
-    
-    std::shuffle(m_coords.begin(), m_coords.end(), g);
-    for (const std::pair<int, int>& coord : m_coords)
+    // Bottom to top, alternating direction every row
+    for (int y = rect.maxY; y >= rect.minY; --y)
+    {
+        if (y % 2)
+        {
+            for (int x = rect.minX; x <= rect.maxX; ++x) updateCell(x, y, rng);
+        }
+        else
+        {
+            for (int x = rect.maxX; x >= rect.minX; --x) updateCell(x, y, rng);
+        }
+    }
+}
+void ParticleGrid::traverseRandomRows(const DirtyRect& rect, Rng& rng)
+{
+    // Bottom to top, each row walked in a random direction from a start column rotated per chunk. 
+    // Sequential like the serpentine scan, without its fixed left/right bias
+    const int rectWidth = rect.maxX - rect.minX + 1;
+    const int offset = rng.bounded(rectWidth);
+    for (int y = rect.maxY; y >= rect.minY; --y)
     {
-        updateCell(coord.first, coord.second);
+        const int dir = rng.coin() ? 1 : rectWidth - 1;
+        int i = offset;
+        for (int n = 0; n < rectWidth; ++n)
+        {
+            updateCell(rect.minX + i, y, rng);
+            i += dir;
+            if (i >= rectWidth) i -= rectWidth;
+        }
     }
-    
-    // Ambient temperature
-    // Phase 1: accumulate deltas
-    std::vector<float> accumulatedDelta(m_particles.size(), 0.f);
+}
+void ParticleGrid::updateHeat(int chunk)
+{
+    m_heat.computeDeltas(m_temperature.data(), 
+                         m_chunks.chunkMinX(chunk), m_chunks.chunkMinY(chunk), 
+                         m_chunks.chunkMaxX(chunk), m_chunks.chunkMaxY(chunk));
+}
+void ParticleGrid::updatePhases(int chunk, int worker)
+{
+    // Stage 1: apply the heat delta to every cell with a branch-free sweep. Cells sitting at or past one of 
+    // their transition points keep their delta and get queued for the latent heat state machine instead
+    constexpr uint8_t kTemperatureChanged { 1 << 0 };
+    constexpr uint8_t kNearTransition     { 1 << 1 };
+
+    const float* heatDelta = m_heat.deltas();
+    float maxDelta = 0.f;
+    std::vector<int>& transitionCells = m_phaseScratch[worker].transitionCells;
+    std::vector<float>& storedDeltas = m_phaseScratch[worker].storedDeltas;
+    transitionCells.clear();
+    storedDeltas.clear();
+
+    const int x0 = m_chunks.chunkMinX(chunk), x1 = m_chunks.chunkMaxX(chunk);
+    const int y0 = m_chunks.chunkMinY(chunk), y1 = m_chunks.chunkMaxY(chunk);
+    const int rowLength = x1 - x0 + 1;
+    for (int y = y0; y <= y1; ++y)
+    {
+        const int rowStart = y * width + x0;
+        const ParticleType* type = &m_type[rowStart];
+        const ParticlePhase* phase = &m_phase[rowStart];
+        const float* heat = &heatDelta[rowStart];
+        float* temperature = &m_temperature[rowStart];
+        float* temperatureDelta = &m_temperatureDelta[rowStart];
+        float* latentHeat = &m_latentHeat[rowStart];
+        uint8_t* rowFlags = m_phaseScratch[worker].rowFlags.data();
+        float* rowStoredDeltas = m_phaseScratch[worker].rowStoredDeltas.data();
+
+        for (int i = 0; i < rowLength; ++i)
+        {
+            const float delta = temperatureDelta[i] + heat[i];
+            const float temp = temperature[i];
+            const float newTemp = std::clamp(temp + delta, Util::kAbsZero, Util::kMaxTemp);
+            const bool stable = kPhaseStableRanges[static_cast<size_t>(type[i])][static_cast<size_t>(phase[i])].contains(temp);
+
+            maxDelta = std::max(maxDelta, std::abs(delta));
+            rowFlags[i] = stable ? (newTemp != temp ? kTemperatureChanged : 0) : kNearTransition;
+            rowStoredDeltas[i] = temperatureDelta[i];
+            temperature[i] = stable ? newTemp : temp;
+            temperatureDelta[i] = stable ? 0.f : delta;
+            latentHeat[i] = stable ? 0.f : latentHeat[i];
+        }
 
-    const std::pair<int, int> neighborOffsets[] = {
-        {1, 0}, {-1, 0}, {0, 1}, {0, -1}
-        //{1, 0}, {1, 1}, {0, 1}, {-1, 1}
-    };
+        for (int i = 0; i < rowLength; ++i)
+        {
+            if (rowFlags[i] == kTemperatureChanged) markHeatRedraw(rowStart + i);
+            else if (rowFlags[i] == kNearTransition)
+            {
+                transitionCells.push_back(rowStart + i);
+                storedDeltas.push_back(rowStoredDeltas[i]);
+            }
+        }
+    }
 
-    for (const auto& coord : m_coords)
+    // Stage 2
+    for (size_t i = 0; i < transitionCells.size(); ++i)
     {
-        int x = coord.first;
-        int y = coord.second;
-        Cell* cell = getCell(x, y);
-        if (!cell) continue;
+        applyPhaseTransition(transitionCells[i], storedDeltas[i]);
+    }
 
-        ParticleState a = cell->particleState();
-        int idxA = y * width + x;
+    if (maxDelta > kThermalEpsilon)
+    {
+        m_chunks.wakeThermal(chunk);
+    }
+}
+void ParticleGrid::applyPhaseTransition(int idx, float storedDelta)
+{
+    // temperatureDelta already holds this step's heat from stage 1
+    ParticleState state = particleState(idx);
+    const ParticleProperties& props = particleProperties(state.type);
+    const float inverseSpecificHeat = kInverseSpecificHeat[static_cast<size_t>(state.type)];
 
-        for (const auto& offset : neighborOffsets)
-        {
-            int nx = x + offset.first;
-            int ny = y + offset.second;
+    float heatEnergy = state.temperatureDelta;
+    const float maxLatentTransferRate = 5.f;
 
-            float tempDiff;
-            float delta;
+    // --- SOLID TO LIQUID (MELTING) ---
+    if (state.phase == ParticlePhase::Solid && state.temperature >= props.meltingPoint)
+    {
+        if (heatEnergy > 0) { // Particle is absorbing heat
+            // How much latent heat do we still need to absorb to melt?
+            float neededLatent = props.latentHeatFusion - state.latentHeatAbsorbed;
+            // How much latent heat can we transfer this step?
+            float actualLatentTransferred = std::min({heatEnergy, neededLatent, maxLatentTransferRate});
 
-            Cell* neighbor = getCell(nx, ny);
-            if (neighbor)
-            {
-                ParticleState b = neighbor->particleState();
-                int idxB = ny * width + nx;
-            
-                tempDiff = b.temperature - a.temperature;
-                delta = tempDiff * 0.05f; 
-
-                accumulatedDelta[idxA] += delta;
-                accumulatedDelta[idxB] -= delta;
-            }
-            else
-            {
-                tempDiff = ambientTemperature - a.temperature;
-                delta = tempDiff * 0.05f;
+            state.latentHeatAbsorbed += actualLatentTransferred;
+            state.temperature = props.meltingPoint; // Keep temp at melting point during phase change
+
+            // Remove the transferred latent heat from heatEnergy, any remainder will be used for temperature change later
+            heatEnergy -= actualLatentTransferred; // This is crucial for conservation
 
-                accumulatedDelta[idxA] += delta;
+            if (state.latentHeatAbsorbed >= props.latentHeatFusion - 1e-6f) // Use epsilon for float comparison
+            {
+                state.phase = ParticlePhase::Liquid;
+                state.latentHeatAbsorbed = 0.f; // Reset after complete phase change
+                // Any remaining heatEnergy should now go into heating the liquid
+                state.temperature += (heatEnergy * inverseSpecificHeat); // Apply remaining heat to temperature
             }
+        } else { // Solid at melting point, but losing heat. It should cool as a solid.
+            state.temperature += state.temperatureDelta; // Allow it to cool below melting point
+            state.latentHeatAbsorbed = 0.f; // Not in a latent heat process
         }
+        state.temperatureDelta = 0.f; // Reset delta at end of block
     }
-
-    // Phase 2: Apply accumulated deltas, finalize temps and reset deltas
-    for (Cell& cell : m_particles)
+    // --- LIQUID TO GAS (VAPORIZATION) ---
+    else if (state.phase == ParticlePhase::Liquid && state.temperature >= props.boilingPoint)
     {
-        ParticleState state = cell.particleState();
-        const ParticleProperties& props = kParticleProperties.at(state.type);
+        if (heatEnergy > 0) { // Particle is absorbing heat
+            float neededLatent = props.latentHeatVaporization - state.latentHeatAbsorbed;
+            float actualLatentTransferred = std::min({heatEnergy, neededLatent, maxLatentTransferRate});
 
-        // Apply heat change
-        state.temperatureDelta += accumulatedDelta[cell.y * width + cell.x];
-        float heatEnergy = state.temperatureDelta;
-        const float maxLatentTransferRate = 5.f;
+            state.latentHeatAbsorbed += actualLatentTransferred;
+            state.temperature = props.boilingPoint;
 
-        // --- SOLID TO LIQUID (MELTING) ---
-        if (state.phase == ParticlePhase::Solid && state.temperature >= props.meltingPoint)
-        {
-            if (heatEnergy > 0) { // Particle is absorbing heat
-                // How much latent heat do we still need to absorb to melt?
-                float neededLatent = props.latentHeatFusion - state.latentHeatAbsorbed;
-                // How much latent heat can we transfer this step?
-                float actualLatentTransferred = std::min({heatEnergy, neededLatent, maxLatentTransferRate});
-
-                state.latentHeatAbsorbed += actualLatentTransferred;
-                state.temperature = props.meltingPoint; // Keep temp at melting point during phase change
-
-                // Remove the transferred latent heat from heatEnergy, any remainder will be used for temperature change later
-                heatEnergy -= actualLatentTransferred; // This is crucial for conservation
-
-                if (state.latentHeatAbsorbed >= props.latentHeatFusion - 1e-6f) // Use epsilon for float comparison
-                {
-                    state.phase = ParticlePhase::Liquid;
-                    state.latentHeatAbsorbed = 0.f; // Reset after complete phase change
-                    // Any remaining heatEnergy should now go into heating the liquid
-                    state.temperature += (heatEnergy / props.specificHeat); // Apply remaining heat to temperature
-                }
-            } else { // Solid at melting point, but losing heat. It should cool as a solid.
-                state.temperature += state.temperatureDelta; // Allow it to cool below melting point
-                state.latentHeatAbsorbed = 0.f; // Not in a latent heat process
-            }
-            state.temperatureDelta = 0.f; // Reset delta at end of block
-        }
-        // --- LIQUID TO GAS (VAPORIZATION) ---
-        else if (state.phase == ParticlePhase::Liquid && state.temperature >= props.boilingPoint)
-        {
-            if (heatEnergy > 0) { // Particle is absorbing heat
-                float neededLatent = props.latentHeatVaporization - state.latentHeatAbsorbed;
-                float actualLatentTransferred = std::min({heatEnergy, neededLatent, maxLatentTransferRate});
-
-                state.latentHeatAbsorbed += actualLatentTransferred;
-                state.temperature = props.boilingPoint;
-
-                heatEnergy -= actualLatentTransferred; // Remove transferred latent heat
-
-                if (state.latentHeatAbsorbed >= props.latentHeatVaporization - 1e-6f)
-                {
-                    state.phase = ParticlePhase::Gas;
-                    state.latentHeatAbsorbed = 0.f;
-                    state.temperature += (heatEnergy / props.specificHeat); // Apply remaining heat to temperature
-                }
-            } else { // Liquid at boiling point, losing heat. Should condense or cool.
-                state.temperature += state.temperatureDelta;
+            heatEnergy -= actualLatentTransferred; // Remove transferred latent heat
+
+            if (state.latentHeatAbsorbed >= props.latentHeatVaporization - 1e-6f)
+            {
+                state.phase = ParticlePhase::Gas;
                 state.latentHeatAbsorbed = 0.f;
+                state.temperature += (heatEnergy * inverseSpecificHeat); // Apply remaining heat to temperature
             }
-            state.temperatureDelta = 0.f;
+        } else { // Liquid at boiling point, losing heat. Should condense or cool.
+            state.temperature += state.temperatureDelta;
+            state.latentHeatAbsorbed = 0.f;
         }
-        // --- LIQUID TO SOLID (FREEZING) ---
-        else if (state.phase == ParticlePhase::Liquid && state.temperature <= props.meltingPoint)
-        {
-            if (heatEnergy < 0) { // Particle is losing heat (freezing)
-                // How much latent heat do we still need to release to freeze?
-                // Note: state.latentHeatAbsorbed is negative here, so props.latentHeatFusion + state.latentHeatAbsorbed
-                // (e.g., 100 + (-20)) means we still need to release 80.
-                float neededToRelease = props.latentHeatFusion + state.latentHeatAbsorbed;
-                // How much heat can we release this step? Use abs for comparison with maxLatentTransferRate
-                float actualLatentTransferred = std::max(heatEnergy, -maxLatentTransferRate); // This is already negative
-
-                // Ensure we don't 'over-release' more than what's needed for the phase change
-                // Or, more simply, clamp the change itself.
-                // If heatEnergy is -10 and maxLatent is 5, actualTransferred is -5.
-                // If heatEnergy is -2 and maxLatent is 5, actualTransferred is -2.
-                // We need to ensure we don't go past neededToRelease (negative value)
-                actualLatentTransferred = std::max(actualLatentTransferred, -neededToRelease); // Clamp to not release too much past 0
-
-                state.latentHeatAbsorbed += actualLatentTransferred; // Decreases (becomes more negative)
-                state.temperature = props.meltingPoint; // Clamps temperature during freezing
-
-                // Remaining heatEnergy is what wasn't used for latent heat. It's still negative.
-                heatEnergy -= actualLatentTransferred; // This will become more negative (remaining energy to remove)
-
-                if (state.latentHeatAbsorbed <= -props.latentHeatFusion + 1e-6f) // Use epsilon for float comparison
-                {
-                    state.phase = ParticlePhase::Solid;
-                    state.latentHeatAbsorbed = 0.0f; // Reset after complete phase change
-                    // Any remaining negative heatEnergy should now go into cooling the solid
-                    state.temperature += (heatEnergy / props.specificHeat); // Apply remaining heat to temperature
-                }
-            } else { // Liquid at melting point, but gaining heat. Should warm or re-melt.
-                state.temperature += state.temperatureDelta;
-                state.latentHeatAbsorbed = 0.f;
+        state.temperatureDelta = 0.f;
+    }
+    // --- LIQUID TO SOLID (FREEZING) ---
+    else if (state.phase == ParticlePhase::Liquid && state.temperature <= props.meltingPoint)
+    {
+        if (heatEnergy < 0) { // Particle is losing heat (freezing)
+            // How much latent heat do we still need to release to freeze?
+            // Note: state.latentHeatAbsorbed is negative here, so props.latentHeatFusion + state.latentHeatAbsorbed
+            // (e.g., 100 + (-20)) means we still need to release 80.
+            float neededToRelease = props.latentHeatFusion + state.latentHeatAbsorbed;
+            // How much heat can we release this step? Use abs for comparison with maxLatentTransferRate
+            float actualLatentTransferred = std::max(heatEnergy, -maxLatentTransferRate); // This is already negative
+
+            // Ensure we don't 'over-release' more than what's needed for the phase change
+            // Or, more simply, clamp the change itself.
+            // If heatEnergy is -10 and maxLatent is 5, actualTransferred is -5.
+            // If heatEnergy is -2 and maxLatent is 5, actualTransferred is -2.
+            // We need to ensure we don't go past neededToRelease (negative value)
+            actualLatentTransferred = std::max(actualLatentTransferred, -neededToRelease); // Clamp to not release too much past 0
+
+            state.latentHeatAbsorbed += actualLatentTransferred; // Decreases (becomes more negative)
+            state.temperature = props.meltingPoint; // Clamps temperature during freezing
+
+            // Remaining heatEnergy is what wasn't used for latent heat. It's still negative.
+            heatEnergy -= actualLatentTransferred; // This will become more negative (remaining energy to remove)
+
+            if (state.latentHeatAbsorbed <= -props.latentHeatFusion + 1e-6f) // Use epsilon for float comparison
+            {
+                state.phase = ParticlePhase::Solid;
+                state.latentHeatAbsorbed = 0.0f; // Reset after complete phase change
+                // Any remaining negative heatEnergy should now go into cooling the solid
+                state.temperature += (heatEnergy * inverseSpecificHeat); // Apply remaining heat to temperature
             }
-            state.temperatureDelta = 0.f;
+        } else { // Liquid at melting point, but gaining heat. Should warm or re-melt.
+            state.temperature += state.temperatureDelta;
+            state.latentHeatAbsorbed = 0.f;
         }
-        // --- GAS TO LIQUID (CONDENSATION) ---
-        else if (state.phase == ParticlePhase::Gas && state.temperature <= props.boilingPoint)
-        {
-            if (heatEnergy < 0) { // Particle is losing heat (condensing)
-                float neededToRelease = props.latentHeatVaporization + state.latentHeatAbsorbed;
-                float actualLatentTransferred = std::max(heatEnergy, -maxLatentTransferRate);
-                actualLatentTransferred = std::max(actualLatentTransferred, -neededToRelease);
-
-                state.latentHeatAbsorbed += actualLatentTransferred;
-                state.temperature = props.boilingPoint;
-
-                heatEnergy -= actualLatentTransferred; // Remaining negative heat
-
-                if (state.latentHeatAbsorbed <= -props.latentHeatVaporization + 1e-6f)
-                {
-                    state.phase = ParticlePhase::Liquid;
-                    state.latentHeatAbsorbed = 0.0f;
-                    state.temperature += (heatEnergy / props.specificHeat); // Apply remaining heat to temperature
-                }
-            } else { // Gas at boiling point, but gaining heat. Should heat up.
-                state.temperature += state.temperatureDelta;
-                state.latentHeatAbsorbed = 0.f;
+        state.temperatureDelta = 0.f;
+    }
+    // --- GAS TO LIQUID (CONDENSATION) ---
+    else if (state.phase == ParticlePhase::Gas && state.temperature <= props.boilingPoint)
+    {
+        if (heatEnergy < 0) { // Particle is losing heat (condensing)
+            float neededToRelease = props.latentHeatVaporization + state.latentHeatAbsorbed;
+            float actualLatentTransferred = std::max(heatEnergy, -maxLatentTransferRate);
+            actualLatentTransferred = std::max(actualLatentTransferred, -neededToRelease);
+
+            state.latentHeatAbsorbed += actualLatentTransferred;
+            state.temperature = props.boilingPoint;
+
+            heatEnergy -= actualLatentTransferred; // Remaining negative heat
+
+            if (state.latentHeatAbsorbed <= -props.latentHeatVaporization + 1e-6f)
+            {
+                state.phase = ParticlePhase::Liquid;
+                state.latentHeatAbsorbed = 0.0f;
+                state.temperature += (heatEnergy * inverseSpecificHeat); // Apply remaining heat to temperature
             }
-            state.temperatureDelta = 0.f;
-        }
-        // --- NO PHASE CHANGE / DEFAULT TEMPERATURE UPDATE ---
-        else
-        {
+        } else { // Gas at boiling point, but gaining heat. Should heat up.
             state.temperature += state.temperatureDelta;
-            state.latentHeatAbsorbed = 0.f; // Only reset if NOT actively in a phase transition
-            state.temperatureDelta = 0.f; // Always reset delta for next step
+            state.latentHeatAbsorbed = 0.f;
         }
+        state.temperatureDelta = 0.f;
+    }
+    // --- NO PHASE CHANGE / DEFAULT TEMPERATURE UPDATE ---
+    else
+    {
+        state.temperature += state.temperatureDelta;
+        state.latentHeatAbsorbed = 0.f; // Only reset if NOT actively in a phase transition
+        state.temperatureDelta = 0.f; // Always reset delta for next step
+    }
+
+    // Clamp temperature
+    state.temperature = std::min(std::max(state.temperature, Util::kAbsZero), Util::kMaxTemp);
 
-        // Clamp temperature
-        state.temperature = std::min(std::max(state.temperature, Util::kAbsZero), Util::kMaxTemp);
-        cell.setParticleState(state);
+    // Same rule as setParticleState, against the delta stored before stage 1: an unchanged type, temperature and
+    // delta drops the whole write, phase and latent heat included
+    if (state.temperature == m_temperature[idx] && state.temperatureDelta == storedDelta)
+    {
+        m_temperatureDelta[idx] = storedDelta;
+        return;
     }
+    if (state.temperature != m_temperature[idx])
+    {
+        markHeatRedraw(idx);
+    }
+    if (state.phase != m_phase[idx])
+    {
+        // Melted/frozen particles move differently
+        wakeCell(idx);
+    }
+    m_phase[idx] = state.phase;
+    m_temperature[idx] = state.temperature;
+    m_temperatureDelta[idx] = state.temperatureDelta;
+    m_latentHeat[idx] = state.latentHeatAbsorbed;
 }
 void ParticleGrid::clear(ParticleType type)
 {
-    for (Cell& cell : m_particles)
-    {
-        cell.setParticleState(defaultParticleState(type, ambientTemperature));
-    }
+    const ParticleState state = defaultParticleState(type, ambientTemperature);
+    std::fill(m_type.begin(), m_type.end(), state.type);
+    std::fill(m_phase.begin(), m_phase.end(), state.phase);
+    std::fill(m_temperature.begin(), m_temperature.end(), state.temperature);
+    std::fill(m_temperatureDelta.begin(), m_temperatureDelta.end(), state.temperatureDelta);
+    std::fill(m_latentHeat.begin(), m_latentHeat.end(), state.latentHeatAbsorbed);
+    markAllForRedraw();
+    m_chunks.wakeAll();
 }
 void ParticleGrid::toggleShowTemp()
 {
     m_showTemperature = !m_showTemperature;
-    for (Cell& cell : m_particles)
-    {
-        cell.markForRedraw();
-    }
 }
 bool ParticleGrid::showTemp() const
 {
@@ -471,42 +1120,43 @@ void ParticleGrid::setTempColorMode(Util::TemperatureColorMode mode)
     }
 
     m_tempColorMode = mode;
-    for (Cell& cell : m_particles)
-    {
-        cell.markForRedraw();
-    }
+    m_thermalRebuildPending = true;
 }
 Util::TemperatureColorMode ParticleGrid::tempColorMode() const 
 {
     return m_tempColorMode;
 }
 
-void ParticleGrid::updateCell(int x, int y)
+void ParticleGrid::updateCell(int x, int y, Rng& rng)
 {
-    Cell* cell = getCell(x, y);
-    if (cell == nullptr)
+    int cell = cellIndex(x, y);
+    if (cell < 0)
+    {
+        return;
+    }
+    if (m_traversalMode != TraversalMode::Shuffle && (m_flags[cell] & CellFlags::Moved))
     {
         return;
     }
 
     // Positioning
-    ParticleUpdate update = { .nextCell = nullptr, .mode = ParticleUpdate::NOOP };
-    switch (cell->particleState().phase)
+    ParticleUpdate update = doNothing;
+    switch (m_phase[cell])
     {
     case ParticlePhase::Solid:
-        update = particleUpdateFunc_Solid(this, x, y);
+        update = particleUpdateFunc_Solid(this, rng, x, y);
         break;
     
     case ParticlePhase::Liquid:
-        update = particleUpdateFunc_Liquid(this, x, y);
+        update = particleUpdateFunc_Liquid(this, rng, x, y);
         break;
     
     case ParticlePhase::Gas:
-        update = particleUpdateFunc_Gas(this, x, y);
+        update = particleUpdateFunc_Gas(this, rng, x, y);
         break;
 
     case ParticlePhase::Static:
-        update = particleUpdateFunc_Static(this, x, y);
+        update = particleUpdateFunc_Static(this, rng, x, y);
         break;
 
     default:
@@ -517,17 +1167,19 @@ void ParticleGrid::updateCell(int x, int y)
     switch (update.mode)
     {
     case ParticleUpdate::Move:
-        update.nextCell->setParticleState(cell->particleState());
-        cell->setParticleState({ .type = ParticleType::Air, .temperature = 0 });
+        setParticleState(update.nextCell, particleState(cell));
+        setParticleState(cell, defaultParticleState(ParticleType::Air, 0.f));
         break;
 
     case ParticleUpdate::Swap:
-    {
-        ParticleState tmp = cell->particleState();
-        cell->setParticleState(update.nextCell->particleState());
-        update.nextCell->setParticleState(tmp);
+        swapParticles(cell, update.nextCell);
+        m_flags[cell] |= CellFlags::Moved;
+        m_flags[update.nextCell] |= CellFlags::Moved;
+        break;
+
+    case ParticleUpdate::Wait:
+        m_chunks.wakeCell(x, y);
         break;
-    }
 
     case ParticleUpdate::NOOP:
     default:
@@ -535,38 +1187,3 @@ void ParticleGrid::updateCell(int x, int y)
 
     }
 }
-void ParticleGrid::update_b2t()
-{
-    for (int y = height; y >= 0; --y)
-    {
-        int scanDir = (y % 2) ? 1 : -1;
-        int startX = (scanDir == 1) ? 0 : width;
-        int endX = (startX == 0) ? width : -1;
-
-        int x = startX;
-        while (x != endX)
-        {
-            Cell* cell = getCell(x, y);
-            if (cell != nullptr)
-            {
-                updateCell(cell->x, cell->y);
-            }
-
-            x += scanDir;
-        }
-    }
-}
-void ParticleGrid::update_t2b()
-{
-    for (int y = 0; y < height; ++y)
-    {
-        for (int x = 0; x < width; ++x)
-        {
-            Cell* cell = getCell(x, y);
-            if (cell != nullptr)
-            {
-                updateCell(cell->x, cell->y);
-            }
-        }
-    }
-}
\ No newline at end of file
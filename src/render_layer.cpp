@@ -0,0 +1,156 @@
+#include "render_layer.h"
+
+#include <SDL3/SDL.h>
+#include <algorithm>
+#include <cstring>
+
+
+RenderLayer::RenderLayer(SDL_Renderer* renderer, int width, int height, bool blended)
+    : m_width(width)
+    , m_height(height)
+    , m_tilesX((width + kTileSize - 1) / kTileSize)
+    , m_tilesY((height + kTileSize - 1) / kTileSize)
+    , m_renderer(renderer)
+    , m_blended(blended)
+{
+    m_pixels.assign(static_cast<size_t>(width) * height, 0);
+    m_tileRects.resize(static_cast<size_t>(m_tilesX) * m_tilesY);
+    markAll();
+
+    // Headless layers keep only the CPU copy
+    if (!renderer) return;
+    const int maxTextureSize = static_cast<int>(SDL_GetNumberProperty(SDL_GetRendererProperties(renderer), SDL_PROP_RENDERER_MAX_TEXTURE_SIZE_NUMBER, 0));
+    if (maxTextureSize >= kTileSize)
+    {
+        m_textureSize = std::min(m_textureSize, maxTextureSize / kTileSize * kTileSize);
+    }
+    m_texturesX = (width + m_textureSize - 1) / m_textureSize;
+    m_texturesY = (height + m_textureSize - 1) / m_textureSize;
+    m_textures.assign(static_cast<size_t>(m_texturesX) * m_texturesY, nullptr);
+}
+RenderLayer::~RenderLayer()
+{
+    for (SDL_Texture* texture : m_textures)
+    {
+        if (texture) SDL_DestroyTexture(texture);
+    }
+}
+
+int RenderLayer::upload(const DirtyRect& view)
+{
+    if (!m_renderer)
+    {
+        std::fill(m_tileRects.begin(), m_tileRects.end(), DirtyRect());
+        return 0;
+    }
+
+    // Merge runs of neighbouring dirty tiles in each tile row so a wide change is one lock per texture, not one per tile.
+    // Textures that don't exist yet are skipped; they get all their pixels when created
+    int uploadedPixels = 0;
+    for (int ty = 0; ty < m_tilesY; ++ty)
+    {
+        DirtyRect run;
+        for (int tx = 0; tx <= m_tilesX; ++tx)
+        {
+            DirtyRect* rect = tx < m_tilesX ? &m_tileRects[ty * m_tilesX + tx] : nullptr;
+            if (rect && !rect->empty())
+            {
+                run.include(rect->minX, rect->minY, rect->maxX, rect->maxY);
+                rect->reset();
+                continue;
+            }
+            if (run.empty()) continue;
+
+            const DirtyRect textures = texturesIn(run);
+            for (int y = textures.minY; y <= textures.maxY; ++y)
+            {
+                for (int x = textures.minX; x <= textures.maxX; ++x)
+                {
+                    if (!m_textures[y * m_texturesX + x]) continue;
+
+                    const DirtyRect cells = textureCells(x, y);
+                    const int x0 = std::max(run.minX, cells.minX);
+                    const int y0 = std::max(run.minY, cells.minY);
+                    const int x1 = std::min(run.maxX, cells.maxX);
+                    const int y1 = std::min(run.maxY, cells.maxY);
+                    uploadedPixels += uploadRegion(x, y, { x0, y0, x1 - x0 + 1, y1 - y0 + 1 });
+                }
+            }
+            run.reset();
+        }
+    }
+
+    if (view.empty()) return uploadedPixels;
+    const DirtyRect visible = texturesIn(view);
+    for (int y = visible.minY; y <= visible.maxY; ++y)
+    {
+        for (int x = visible.minX; x <= visible.maxX; ++x)
+        {
+            SDL_Texture*& texture = m_textures[y * m_texturesX + x];
+            if (texture) continue;
+
+            const DirtyRect cells = textureCells(x, y);
+            texture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+                                        cells.maxX - cells.minX + 1, cells.maxY - cells.minY + 1);
+            if (!texture) continue;
+            SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST);
+            SDL_SetTextureBlendMode(texture, m_blended ? SDL_BLENDMODE_BLEND : SDL_BLENDMODE_NONE);
+            uploadedPixels += uploadRegion(x, y, { cells.minX, cells.minY, cells.maxX - cells.minX + 1, cells.maxY - cells.minY + 1 });
+        }
+    }
+    return uploadedPixels;
+}
+void RenderLayer::render(const DirtyRect& view, const Camera& camera) const
+{
+    if (!m_renderer || view.empty()) return;
+
+    const DirtyRect visible = texturesIn(view);
+    for (int y = visible.minY; y <= visible.maxY; ++y)
+    {
+        for (int x = visible.minX; x <= visible.maxX; ++x)
+        {
+            SDL_Texture* texture = m_textures[y * m_texturesX + x];
+            if (!texture) continue;
+
+            const SDL_FRect dst = camera.screenRect(textureCells(x, y));
+            SDL_RenderTexture(m_renderer, texture, nullptr, &dst);
+        }
+    }
+}
+
+int RenderLayer::textureCount() const
+{
+    return static_cast<int>(std::count_if(m_textures.begin(), m_textures.end(), [](SDL_Texture* texture) { return texture; }));
+}
+
+DirtyRect RenderLayer::texturesIn(const DirtyRect& cells) const
+{
+    DirtyRect textures;
+    textures.include(cells.minX / m_textureSize, cells.minY / m_textureSize, cells.maxX / m_textureSize, cells.maxY / m_textureSize);
+    return textures;
+}
+DirtyRect RenderLayer::textureCells(int tx, int ty) const
+{
+    DirtyRect cells;
+    cells.include(tx * m_textureSize, ty * m_textureSize,
+                  std::min((tx + 1) * m_textureSize, m_width) - 1, std::min((ty + 1) * m_textureSize, m_height) - 1);
+    return cells;
+}
+int RenderLayer::uploadRegion(int tx, int ty, const SDL_Rect& region)
+{
+    // Lock in texture-local coordinates
+    const SDL_Rect local { region.x - tx * m_textureSize, region.y - ty * m_textureSize, region.w, region.h };
+    SDL_Texture* texture = m_textures[ty * m_texturesX + tx];
+    void* pixels;
+    int pitch;
+    if (!SDL_LockTexture(texture, &local, &pixels, &pitch)) return 0;
+
+    // The texture rows may be padded, so step by its pitch rather than the layer width
+    for (int row = 0; row < region.h; ++row)
+    {
+        std::memcpy(static_cast<uint8_t*>(pixels) + static_cast<size_t>(row) * pitch,
+                    &m_pixels[static_cast<size_t>(region.y + row) * m_width + region.x], region.w * sizeof(uint32_t));
+    }
+    SDL_UnlockTexture(texture);
+    return region.w * region.h;
+}
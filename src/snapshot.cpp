@@ -0,0 +1,259 @@
+#include "snapshot.h"
+#include "particle_grid.h"
+#include "rle.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if !defined(EMSCRIPTEN) && (defined(__unix__) || defined(__APPLE__))
+#define SNAPSHOT_USE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+constexpr char kSnapshotMagic[4] { 'S', 'N', 'D', 'T' };
+// Reads back byte swapped on a host of the other byte order
+constexpr uint32_t kByteOrderMark { 0x01020304 };
+// Largest grid a file may describe, so a corrupt header can't ask for an absurd allocation
+constexpr uint64_t kMaxCells { 1ull << 28 };
+
+enum class TypeEncoding : uint32_t
+{
+    Raw,
+    Rle
+};
+
+struct SnapshotHeader
+{
+    char magic[4];
+    uint32_t byteOrder;
+    uint32_t version;
+    TypeEncoding typeEncoding;
+    int32_t width;
+    int32_t height;
+    float ambientTemperature;
+    uint32_t reserved;
+    uint64_t seed;
+    uint64_t frame;
+    // Size of the encoded type plane, without its padding
+    uint64_t typeBytes;
+};
+static_assert(sizeof(SnapshotHeader) % 4 == 0);
+
+static size_t padded(size_t bytes)
+{
+    return (bytes + 3) & ~size_t(3);
+}
+
+// The whole file, mapped read-only where the platform allows, read into memory otherwise
+class SnapshotFile
+{
+public:
+    SnapshotFile() = default;
+    SnapshotFile(const SnapshotFile&) = delete;
+    SnapshotFile& operator=(const SnapshotFile&) = delete;
+    ~SnapshotFile()
+    {
+#ifdef SNAPSHOT_USE_MMAP
+        if (m_mapping) munmap(m_mapping, m_size);
+#endif
+    }
+
+    bool open(const std::filesystem::path& path)
+    {
+#ifdef SNAPSHOT_USE_MMAP
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            m_size = static_cast<size_t>(info.st_size);
+            void* mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED)
+            {
+                m_mapping = mapping;
+                m_data = static_cast<const uint8_t*>(mapping);
+                // Planes are copied out front to back
+                madvise(mapping, m_size, MADV_SEQUENTIAL);
+            }
+        }
+        ::close(fd);
+        if (m_data) return true;
+#endif
+        FILE* file = std::fopen(path.string().c_str(), "rb");
+        if (!file) return false;
+        std::fseek(file, 0, SEEK_END);
+        const long size = std::ftell(file);
+        std::fseek(file, 0, SEEK_SET);
+        if (size > 0)
+        {
+            m_buffer.resize(static_cast<size_t>(size));
+            m_buffer.resize(std::fread(m_buffer.data(), 1, m_buffer.size(), file));
+        }
+        std::fclose(file);
+        m_data = m_buffer.data();
+        m_size = m_buffer.size();
+        return true;
+    }
+
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    const uint8_t* m_data { nullptr };
+    size_t m_size { 0 };
+    void* m_mapping { nullptr };
+    std::vector<uint8_t> m_buffer;
+
+};
+
+bool Snapshot::save(const ParticleGrid& canvas, const std::filesystem::path& path, bool compressTypes, std::string& error)
+{
+    const size_t nCells = static_cast<size_t>(canvas.width) * canvas.height;
+
+    // Keep the type plane raw if the runs come out no smaller
+    std::vector<uint8_t> encodedTypes;
+    if (compressTypes)
+    {
+        Rle::encode(encodedTypes, canvas.m_type.data(), nCells);
+        if (encodedTypes.size() >= nCells) encodedTypes.clear();
+    }
+    const bool typesEncoded = !encodedTypes.empty();
+    const void* types = typesEncoded ? static_cast<const void*>(encodedTypes.data()) : canvas.m_type.data();
+
+    SnapshotHeader header {
+        .magic = { kSnapshotMagic[0], kSnapshotMagic[1], kSnapshotMagic[2], kSnapshotMagic[3] },
+        .byteOrder = kByteOrderMark,
+        .version = kVersion,
+        .typeEncoding = typesEncoded ? TypeEncoding::Rle : TypeEncoding::Raw,
+        .width = canvas.width,
+        .height = canvas.height,
+        .ambientTemperature = canvas.ambientTemperature,
+        .reserved = 0,
+        .seed = canvas.m_seed,
+        .frame = canvas.m_frame,
+        .typeBytes = typesEncoded ? encodedTypes.size() : nCells
+    };
+
+    // Written next to the target and renamed over it once complete, so a failed save leaves the old file intact
+    std::filesystem::path tempPath = path;
+    tempPath += ".tmp";
+    FILE* file = std::fopen(tempPath.string().c_str(), "wb");
+    if (!file)
+    {
+        error = "Failed to open " + tempPath.string() + " for writing";
+        return false;
+    }
+    auto write = [file](const void* data, size_t bytes) {
+        static constexpr uint8_t zeros[4] {};
+        return std::fwrite(data, 1, bytes, file) == bytes && std::fwrite(zeros, 1, padded(bytes) - bytes, file) == padded(bytes) - bytes;
+    };
+    bool ok = write(&header, sizeof(header));
+    ok = ok && write(types, header.typeBytes);
+    ok = ok && write(canvas.m_phase.data(), nCells * sizeof(ParticlePhase));
+    ok = ok && write(canvas.m_temperature.data(), nCells * sizeof(float));
+    ok = ok && write(canvas.m_temperatureDelta.data(), nCells * sizeof(float));
+    ok = ok && write(canvas.m_latentHeat.data(), nCells * sizeof(float));
+    ok = std::fclose(file) == 0 && ok;
+
+    std::error_code fsError;
+    if (ok)
+    {
+        std::filesystem::rename(tempPath, path, fsError);
+        if (!fsError) return true;
+        error = "Failed to replace " + path.string() + ": " + fsError.message();
+    }
+    else
+    {
+        error = "Failed to write " + tempPath.string();
+    }
+    std::filesystem::remove(tempPath, fsError);
+    return false;
+}
+
+std::unique_ptr<ParticleGrid> Snapshot::load(const std::filesystem::path& path, SDL_Renderer* renderer, std::string& error)
+{
+    SnapshotFile file;
+    if (!file.open(path))
+    {
+        error = "Failed to open " + path.string();
+        return nullptr;
+    }
+
+    SnapshotHeader header;
+    if (file.size() < sizeof(header))
+    {
+        error = path.string() + " is not a snapshot";
+        return nullptr;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) != 0)
+    {
+        error = path.string() + " is not a snapshot";
+        return nullptr;
+    }
+    if (header.byteOrder != kByteOrderMark)
+    {
+        error = path.string() + " was saved on a host with the other byte order";
+        return nullptr;
+    }
+    if (header.version != kVersion)
+    {
+        error = path.string() + " is snapshot version " + std::to_string(header.version) + ", expected " + std::to_string(kVersion);
+        return nullptr;
+    }
+
+    const uint64_t nCells = static_cast<uint64_t>(std::max(header.width, 0)) * std::max(header.height, 0);
+    const bool typesEncoded = header.typeEncoding == TypeEncoding::Rle;
+    const bool sizesValid = nCells > 0 && nCells <= kMaxCells && header.typeBytes <= file.size() &&
+        (typesEncoded || header.typeEncoding == TypeEncoding::Raw) && (typesEncoded || header.typeBytes == nCells);
+    const size_t typesOffset = sizeof(header);
+    const size_t phaseOffset = sizesValid ? typesOffset + padded(header.typeBytes) : 0;
+    const size_t temperatureOffset = phaseOffset + padded(nCells * sizeof(ParticlePhase));
+    const size_t planeBytes = nCells * sizeof(float);
+    if (!sizesValid || file.size() < temperatureOffset + 3 * planeBytes)
+    {
+        error = path.string() + " is truncated or corrupt";
+        return nullptr;
+    }
+
+    auto canvas = std::make_unique<ParticleGrid>(header.width, header.height, renderer, header.seed);
+    canvas->ambientTemperature = header.ambientTemperature;
+    canvas->m_frame = header.frame;
+
+    const uint8_t* data = file.data();
+    if (typesEncoded)
+    {
+        if (!Rle::decode(data + typesOffset, data + typesOffset + header.typeBytes, canvas->m_type.data(), nCells))
+        {
+            error = path.string() + " has a corrupt type plane";
+            return nullptr;
+        }
+    }
+    else
+    {
+        std::memcpy(canvas->m_type.data(), data + typesOffset, nCells * sizeof(ParticleType));
+    }
+    std::memcpy(canvas->m_phase.data(), data + phaseOffset, nCells * sizeof(ParticlePhase));
+    std::memcpy(canvas->m_temperature.data(), data + temperatureOffset, planeBytes);
+    std::memcpy(canvas->m_temperatureDelta.data(), data + temperatureOffset + planeBytes, planeBytes);
+    std::memcpy(canvas->m_latentHeat.data(), data + temperatureOffset + 2 * planeBytes, planeBytes);
+
+    // Out of range enums would index past the property tables
+    for (size_t idx = 0; idx < nCells; ++idx)
+    {
+        if (canvas->m_type[idx] >= ParticleType::COUNT || canvas->m_phase[idx] >= ParticlePhase::COUNT)
+        {
+            error = path.string() + " has an unknown particle type or phase";
+            return nullptr;
+        }
+    }
+
+    // The constructor already marked every cell for redraw and woke every chunk
+    return canvas;
+}
@@ -0,0 +1,163 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cassert>
+
+
+static thread_local int tl_currentWorker { 0 };
+
+ThreadPool::ThreadPool(int threadCount)
+    : m_threadCount(std::clamp(threadCount, 1, maxThreadCount()))
+{
+    startWorkers();
+}
+ThreadPool::~ThreadPool()
+{
+    stopWorkers();
+}
+
+int ThreadPool::threadCount() const
+{
+    return m_threadCount;
+}
+void ThreadPool::setThreadCount(int threadCount)
+{
+    threadCount = std::clamp(threadCount, 1, maxThreadCount());
+    if (threadCount == m_threadCount) return;
+
+    stopWorkers();
+    m_threadCount = threadCount;
+    startWorkers();
+}
+
+void ThreadPool::parallelFor(int taskCount, const std::function<void(int task, int worker)>& fn)
+{
+    if (taskCount <= 0) return;
+    if (m_threadCount == 1 || taskCount == 1)
+    {
+        for (int task = 0; task < taskCount; ++task)
+        {
+            fn(task, tl_currentWorker);
+        }
+        return;
+    }
+
+    // Deal the tasks out round-robin; workers that run dry steal the rest
+    m_job = &fn;
+    m_remaining.store(taskCount, std::memory_order_relaxed);
+    for (int task = 0; task < taskCount; ++task)
+    {
+        WorkerQueue& queue = *m_queues[task % m_threadCount];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(task);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        ++m_generation;
+    }
+    m_wakeCondition.notify_all();
+
+    runTasks(0);
+    while (m_remaining.load(std::memory_order_acquire) > 0)
+    {
+        std::this_thread::yield();
+    }
+    m_job = nullptr;
+}
+
+int ThreadPool::currentWorker()
+{
+    return tl_currentWorker;
+}
+int ThreadPool::maxThreadCount()
+{
+    if (!threadsSupported()) return 1;
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+bool ThreadPool::threadsSupported()
+{
+#if defined(EMSCRIPTEN) && !defined(__EMSCRIPTEN_PTHREADS__)
+    return false;
+#else
+    return true;
+#endif
+}
+
+void ThreadPool::startWorkers()
+{
+    m_stopping = false;
+    m_queues.clear();
+    for (int i = 0; i < m_threadCount; ++i)
+    {
+        m_queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (int i = 1; i < m_threadCount; ++i)
+    {
+        m_threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+void ThreadPool::stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_stopping = true;
+    }
+    m_wakeCondition.notify_all();
+    for (std::thread& thread : m_threads)
+    {
+        thread.join();
+    }
+    m_threads.clear();
+}
+void ThreadPool::workerLoop(int worker)
+{
+    tl_currentWorker = worker;
+
+    uint64_t seenGeneration = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            m_wakeCondition.wait(lock, [&] { return m_stopping || m_generation != seenGeneration; });
+            if (m_stopping) return;
+            seenGeneration = m_generation;
+        }
+        runTasks(worker);
+    }
+}
+bool ThreadPool::nextTask(int worker, int& task)
+{
+    {
+        WorkerQueue& own = *m_queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+
+    for (int i = 1; i < m_threadCount; ++i)
+    {
+        WorkerQueue& victim = *m_queues[(worker + i) % m_threadCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+void ThreadPool::runTasks(int worker)
+{
+    int task;
+    while (nextTask(worker, task))
+    {
+        (*m_job)(task, worker);
+        m_remaining.fetch_sub(1, std::memory_order_release);
+    }
+}
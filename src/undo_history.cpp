@@ -0,0 +1,175 @@
+#include "undo_history.h"
+#include "particle_grid.h"
+#include "rle.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+// Planes are run-length encoded when compression is on, copied as is otherwise
+template <typename T>
+static void encodePlane(std::vector<uint8_t>& out, const T* values, int count, bool compress)
+{
+    if (compress)
+    {
+        Rle::encode(out, values, count);
+        return;
+    }
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(values);
+    out.insert(out.end(), bytes, bytes + count * sizeof(T));
+}
+template <typename T>
+static const uint8_t* decodePlane(const uint8_t* in, const uint8_t* end, T* values, int count, bool compressed)
+{
+    if (compressed) return Rle::decode(in, end, values, count);
+    std::memcpy(values, in, count * sizeof(T));
+    return in + count * sizeof(T);
+}
+
+void UndoHistory::setCanvas(ParticleGrid* canvas)
+{
+    clear();
+    m_canvas = canvas;
+    if (!canvas) return;
+
+    m_chunksX = (canvas->width + kChunkSize - 1) / kChunkSize;
+    const int chunksY = (canvas->height + kChunkSize - 1) / kChunkSize;
+    m_savedBy.assign(static_cast<size_t>(m_chunksX) * chunksY, 0);
+}
+
+void UndoHistory::beginEdit()
+{
+    if (m_editOpen) endEdit();
+    m_edits.emplace_back();
+    m_editOpen = true;
+    ++m_editSerial;
+}
+void UndoHistory::record(int idx)
+{
+    if (!m_editOpen || idx < 0) return;
+
+    const int chunk = (m_canvas->cellY(idx) / kChunkSize) * m_chunksX + m_canvas->cellX(idx) / kChunkSize;
+    if (m_savedBy[chunk] == m_editSerial) return;
+    m_savedBy[chunk] = m_editSerial;
+
+    Edit& edit = m_edits.back();
+    edit.chunks.push_back(saveChunk(chunk));
+    const size_t bytes = edit.chunks.back().data.capacity() + sizeof(ChunkSave);
+    edit.bytes += bytes;
+    m_memoryUsage += bytes;
+    evict();
+}
+void UndoHistory::recordSpan(int y, int x0, int x1)
+{
+    if (!m_editOpen) return;
+    for (int x = x0; x <= x1; x = (x / kChunkSize + 1) * kChunkSize)
+    {
+        record(y * m_canvas->width + x);
+    }
+}
+void UndoHistory::recordRect(const DirtyRect& rect)
+{
+    if (!m_editOpen) return;
+    const int x0 = std::max(rect.minX, 0);
+    const int y0 = std::max(rect.minY, 0);
+    const int x1 = std::min(rect.maxX, m_canvas->width - 1);
+    const int y1 = std::min(rect.maxY, m_canvas->height - 1);
+    for (int y = y0; y <= y1; y = (y / kChunkSize + 1) * kChunkSize)
+    {
+        recordSpan(y, x0, x1);
+    }
+}
+void UndoHistory::endEdit()
+{
+    if (!m_editOpen) return;
+    m_editOpen = false;
+    if (m_edits.back().chunks.empty()) m_edits.pop_back();
+}
+
+bool UndoHistory::undo()
+{
+    if (m_editOpen) endEdit();
+    if (m_edits.empty()) return false;
+
+    const Edit& edit = m_edits.back();
+    for (const ChunkSave& save : edit.chunks)
+    {
+        restoreChunk(save);
+    }
+    m_memoryUsage -= edit.bytes;
+    m_edits.pop_back();
+    return true;
+}
+void UndoHistory::clear()
+{
+    m_edits.clear();
+    m_editOpen = false;
+    m_memoryUsage = 0;
+}
+
+void UndoHistory::setMemoryBudget(size_t bytes)
+{
+    m_memoryBudget = bytes;
+    evict();
+}
+
+// The chunk's cells as a grid rect
+static DirtyRect chunkRect(int chunk, int chunksX)
+{
+    DirtyRect rect;
+    constexpr int size { UndoHistory::kChunkSize };
+    rect.include((chunk % chunksX) * size, (chunk / chunksX) * size, (chunk % chunksX + 1) * size - 1, (chunk / chunksX + 1) * size - 1);
+    return rect;
+}
+
+UndoHistory::ChunkSave UndoHistory::saveChunk(int chunk) const
+{
+    // Copied out as planes so runs of air at ambient temperature compress well
+    CellRegion region;
+    m_canvas->copyRegion(chunkRect(chunk, m_chunksX), region);
+    const int count = region.width * region.height;
+
+    ChunkSave save { .chunk = chunk, .compressed = m_compress, .data = {} };
+    auto encode = [&](bool compress) {
+        save.data.clear();
+        encodePlane(save.data, region.type.data(), count, compress);
+        encodePlane(save.data, region.phase.data(), count, compress);
+        encodePlane(save.data, region.temperature.data(), count, compress);
+        encodePlane(save.data, region.temperatureDelta.data(), count, compress);
+        encodePlane(save.data, region.latentHeat.data(), count, compress);
+    };
+    encode(save.compressed);
+    // Noisy chunks can come out larger than the raw planes
+    if (save.compressed && save.data.size() >= count * (2 * sizeof(uint8_t) + 3 * sizeof(float)))
+    {
+        save.compressed = false;
+        encode(false);
+    }
+    save.data.shrink_to_fit();
+    return save;
+}
+void UndoHistory::restoreChunk(const ChunkSave& save)
+{
+    const DirtyRect rect = chunkRect(save.chunk, m_chunksX);
+    CellRegion region;
+    region.resize(std::min(rect.maxX, m_canvas->width - 1) - rect.minX + 1, std::min(rect.maxY, m_canvas->height - 1) - rect.minY + 1);
+    const int count = region.width * region.height;
+
+    const uint8_t* in = save.data.data();
+    const uint8_t* end = in + save.data.size();
+    in = decodePlane(in, end, region.type.data(), count, save.compressed);
+    in = decodePlane(in, end, region.phase.data(), count, save.compressed);
+    in = decodePlane(in, end, region.temperature.data(), count, save.compressed);
+    in = decodePlane(in, end, region.temperatureDelta.data(), count, save.compressed);
+    decodePlane(in, end, region.latentHeat.data(), count, save.compressed);
+    m_canvas->pasteRegion(region, rect.minX, rect.minY);
+}
+
+void UndoHistory::evict()
+{
+    while (m_memoryUsage > m_memoryBudget && m_edits.size() > 1)
+    {
+        m_memoryUsage -= m_edits.front().bytes;
+        m_edits.pop_front();
+    }
+}
@@ -1,28 +1,116 @@
 #include "util.h"
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
 
-uint32_t Util::blendRGBA(uint32_t a, uint32_t b)
+
+// The SIMD blends widen each channel to 16 bits and use the same (x + 1 + (x >> 8)) >> 8 divide as
+// blendRGBA(). Pixels are 0xRRGGBBAA, so alpha is the lowest byte, i.e. the first 16-bit lane of a pixel
+#if defined(__AVX2__)
+static __m256i blend8(__m256i a, __m256i b)
 {
-    uint8_t aR, aG, aB, aA,
-          bR, bG, bB, bA,
-          cR, cG, cB, cA;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i max = _mm256_set1_epi16(255);
 
-    aR = (a >> 24) & 0xFF;
-    aG = (a >> 16) & 0xFF;
-    aB = (a >> 8)  & 0xFF;
-    aA = (a >> 0)  & 0xFF;
+    auto blendHalf = [&](__m256i a16, __m256i b16) {
+        __m256i alpha = _mm256_shufflelo_epi16(b16, _MM_SHUFFLE(0, 0, 0, 0));
+        alpha = _mm256_shufflehi_epi16(alpha, _MM_SHUFFLE(0, 0, 0, 0));
+        const __m256i invAlpha = _mm256_sub_epi16(max, alpha);
+        __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(a16, invAlpha), _mm256_mullo_epi16(b16, alpha));
+        x = _mm256_add_epi16(_mm256_add_epi16(x, one), _mm256_srli_epi16(x, 8));
+        return _mm256_srli_epi16(x, 8);
+    };
+    const __m256i lo = blendHalf(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+    const __m256i hi = blendHalf(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+    return _mm256_or_si256(_mm256_packus_epi16(lo, hi), _mm256_set1_epi32(0xFF));
+}
+#endif
+#if defined(__SSE2__)
+static __m128i blend4(__m128i a, __m128i b)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i max = _mm_set1_epi16(255);
 
-    bR = (b >> 24) & 0xFF;
-    bG = (b >> 16) & 0xFF;
-    bB = (b >> 8)  & 0xFF;
-    bA = (b >> 0)  & 0xFF;
+    auto blendHalf = [&](__m128i a16, __m128i b16) {
+        __m128i alpha = _mm_shufflelo_epi16(b16, _MM_SHUFFLE(0, 0, 0, 0));
+        alpha = _mm_shufflehi_epi16(alpha, _MM_SHUFFLE(0, 0, 0, 0));
+        const __m128i invAlpha = _mm_sub_epi16(max, alpha);
+        __m128i x = _mm_add_epi16(_mm_mullo_epi16(a16, invAlpha), _mm_mullo_epi16(b16, alpha));
+        x = _mm_add_epi16(_mm_add_epi16(x, one), _mm_srli_epi16(x, 8));
+        return _mm_srli_epi16(x, 8);
+    };
+    const __m128i lo = blendHalf(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+    const __m128i hi = blendHalf(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+    return _mm_or_si128(_mm_packus_epi16(lo, hi), _mm_set1_epi32(0xFF));
+}
+#elif defined(__wasm_simd128__)
+static v128_t blend4(v128_t a, v128_t b)
+{
+    const v128_t one = wasm_i16x8_splat(1);
+    const v128_t max = wasm_i16x8_splat(255);
 
-    float alpha = bA / 255.f;
+    auto blendHalf = [&](v128_t a16, v128_t b16) {
+        const v128_t alpha = wasm_i16x8_shuffle(b16, b16, 0, 0, 0, 0, 4, 4, 4, 4);
+        const v128_t invAlpha = wasm_i16x8_sub(max, alpha);
+        v128_t x = wasm_i16x8_add(wasm_i16x8_mul(a16, invAlpha), wasm_i16x8_mul(b16, alpha));
+        x = wasm_i16x8_add(wasm_i16x8_add(x, one), wasm_u16x8_shr(x, 8));
+        return wasm_u16x8_shr(x, 8);
+    };
+    const v128_t lo = blendHalf(wasm_u16x8_extend_low_u8x16(a), wasm_u16x8_extend_low_u8x16(b));
+    const v128_t hi = blendHalf(wasm_u16x8_extend_high_u8x16(a), wasm_u16x8_extend_high_u8x16(b));
+    return wasm_v128_or(wasm_u8x16_narrow_i16x8(lo, hi), wasm_i32x4_splat(0xFF));
+}
+#endif
 
-    cR = static_cast<uint8_t>(bR * alpha + aR * (1.f - alpha));
-    cG = static_cast<uint8_t>(bG * alpha + aG * (1.f - alpha));
-    cB = static_cast<uint8_t>(bB * alpha + aB * (1.f - alpha));
-    cA = 255;
+void Util::composeRowScalar(uint32_t* out, const uint32_t* base, const uint32_t* glow, const uint32_t* thermal,
+                            const uint32_t* highlight, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        uint32_t color = blendRGBA(base[i], glow[i]);
+        if (thermal) color = blendRGBA(color, thermal[i]);
+        if (highlight) color = blendRGBA(color, highlight[i]);
+        out[i] = color;
+    }
+}
 
-    return (cR << 24) | (cG << 16) | (cB << 8) | (cA << 0);
-}
\ No newline at end of file
+void Util::composeRow(uint32_t* out, const uint32_t* base, const uint32_t* glow, const uint32_t* thermal,
+                      const uint32_t* highlight, int count)
+{
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i color = blend8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(base + i)),
+                               _mm256_loadu_si256(reinterpret_cast<const __m256i*>(glow + i)));
+        if (thermal) color = blend8(color, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(thermal + i)));
+        if (highlight) color = blend8(color, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(highlight + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), color);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i color = blend4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(base + i)),
+                               _mm_loadu_si128(reinterpret_cast<const __m128i*>(glow + i)));
+        if (thermal) color = blend4(color, _mm_loadu_si128(reinterpret_cast<const __m128i*>(thermal + i)));
+        if (highlight) color = blend4(color, _mm_loadu_si128(reinterpret_cast<const __m128i*>(highlight + i)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), color);
+    }
+#elif defined(__wasm_simd128__)
+    for (; i + 4 <= count; i += 4)
+    {
+        v128_t color = blend4(wasm_v128_load(base + i), wasm_v128_load(glow + i));
+        if (thermal) color = blend4(color, wasm_v128_load(thermal + i));
+        if (highlight) color = blend4(color, wasm_v128_load(highlight + i));
+        wasm_v128_store(out + i, color);
+    }
+#endif
+    composeRowScalar(out + i, base + i, glow + i, thermal ? thermal + i : nullptr,
+                     highlight ? highlight + i : nullptr, count - i);
+}